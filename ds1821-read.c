@@ -16,13 +16,16 @@
  *   ds1821-read              — auto-detect first DS1821 on the bus
  *   ds1821-read 22-0123456789ab  — read a specific device
  *   ds1821-read --loop [N]   — continuous reading every N seconds (default 2)
+ *   ds1821-read --all        — every DS1821 on every w1 master, one thread
+ *                              per master
+ *   ds1821-read --format csv|json  — one line per sample for collectors
  *
  * Prerequisites:
  *   - A w1 bus master driver loaded for the GPIO pin
  *   - The DS1821 must be in 1-Wire mode (not thermostat-only mode)
  */
 
-#define _DEFAULT_SOURCE  /* for usleep() */
+#define _DEFAULT_SOURCE  /* for usleep(); clock_nanosleep() is POSIX 2001 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -33,19 +36,36 @@
 #include <errno.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
 
 /* ── DS1821 Commands ─────────────────────────────────────────────── */
 #define DS1821_CMD_START_CONVERT  0xEE
 #define DS1821_CMD_READ_TEMP     0xAA
 #define DS1821_CMD_READ_COUNTER  0xA0
 #define DS1821_CMD_READ_SLOPE    0xA9
+#define DS1821_CMD_READ_STATUS   0xAC
+
+#define DS1821_STATUS_DONE       0x80
+
+/* ── Conversion wait ─────────────────────────────────────────────── */
+#define CONVERT_TIMEOUT_US    1000000  /* Datasheet max conversion time */
+#define CONVERT_POLL_FIRST_US 100000   /* First DONE poll after Start Convert */
+#define CONVERT_POLL_MIN_US   10000    /* Poll interval, doubling ... */
+#define CONVERT_POLL_MAX_US   80000    /* ... up to this */
 
 /* ── W1 sysfs paths ──────────────────────────────────────────────── */
 #define W1_DEVICES_DIR  "/sys/bus/w1/devices"
+#define W1_MASTER_PREFIX "w1_bus_master"
 #define DS1821_FAMILY   "22"
 
+#define MAX_MASTERS      8
+#define MAX_BUS_DEVICES  32
+
 static volatile int keep_running = 1;
 
+enum out_format { OUT_TEXT, OUT_CSV, OUT_JSON };
+static enum out_format out_format = OUT_TEXT;   /* --format */
+
 static void sigint_handler(int sig)
 {
     (void)sig;
@@ -67,19 +87,14 @@ static int w1_open_rw(const char *device_id)
 }
 
 /*
- * Send a command byte and optionally read back `rlen` response bytes.
+ * One w1 "rw" transaction: write() does bus reset + MATCH ROM and sends
+ * the command byte, and a read() straight after continues the same
+ * transaction without another reset.  So each register read is a
+ * single reset + select + command + data, with no settle delay.
  * Returns 0 on success, -1 on error.
  */
 static int w1_command(int fd, uint8_t cmd, uint8_t *rbuf, int rlen)
 {
-    /* Each open/write/read cycle on w1 "rw" does:
-     *   1. Bus reset
-     *   2. MATCH ROM (selects this slave)
-     *   3. Writes our bytes
-     *   4. Reads back bytes (if we request them)
-     *
-     * We need to seek to 0 before each transaction.
-     */
     if (lseek(fd, 0, SEEK_SET) < 0)
         return -1;
 
@@ -89,11 +104,6 @@ static int w1_command(int fd, uint8_t cmd, uint8_t *rbuf, int rlen)
     }
 
     if (rbuf && rlen > 0) {
-        /* For reads we need a fresh transaction — reset + select + cmd + read */
-        /* Actually on most w1 sysfs implementations, we send cmd and then read
-         * in the same transaction.  Some need a small delay. */
-        usleep(10000);  /* 10 ms settle */
-
         int n = read(fd, rbuf, rlen);
         if (n != rlen) {
             perror("w1 read response");
@@ -104,6 +114,71 @@ static int w1_command(int fd, uint8_t cmd, uint8_t *rbuf, int rlen)
     return 0;
 }
 
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long long clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* When a sample was taken, on both clocks */
+struct stamp {
+    long long mono_ns, wall_ns;
+};
+
+static void stamp_now(struct stamp *st)
+{
+    st->mono_ns = clock_ns(CLOCK_MONOTONIC);
+    st->wall_ns = clock_ns(CLOCK_REALTIME);
+}
+
+/*
+ * Wait for conversions started on `n` devices of one master by polling
+ * DONE in each status register with doubling backoff, bounded by the
+ * datasheet window.  In 1-Wire (one-shot) mode DONE is reliable, so the
+ * wait costs the slowest conversion rather than a fixed 1 s.
+ * Returns the wait in microseconds.
+ */
+static long w1_wait_convert(const int *fds, int n)
+{
+    long long start = now_us();
+    long interval = CONVERT_POLL_MIN_US;
+    int pending[MAX_BUS_DEVICES], left = n;
+
+    for (int i = 0; i < n; i++)
+        pending[i] = 1;
+
+    usleep(CONVERT_POLL_FIRST_US);
+
+    for (;;) {
+        for (int i = 0; i < n; i++) {
+            uint8_t status;
+            if (pending[i] &&
+                w1_command(fds[i], DS1821_CMD_READ_STATUS, &status, 1) == 0 &&
+                (status & DS1821_STATUS_DONE)) {
+                pending[i] = 0;
+                left--;
+            }
+        }
+
+        long remain = CONVERT_TIMEOUT_US - (now_us() - start);
+        if (left == 0 || remain <= 0)
+            break;
+        usleep(interval < remain ? interval : remain);
+        if (interval < CONVERT_POLL_MAX_US)
+            interval *= 2;
+    }
+
+    return now_us() - start;
+}
+
 /* ── Find DS1821 devices on the bus ──────────────────────────────── */
 
 static int find_ds1821(char *out_id, size_t out_sz)
@@ -143,84 +218,262 @@ static int find_ds1821(char *out_id, size_t out_sz)
 
 /* ── Read temperature from real hardware ─────────────────────────── */
 
-static int read_hw_temperature(const char *device_id, float *temp_out, int *millideg_out)
+/*
+ * Read back a finished conversion: one transaction per register (the
+ * DS1821 needs a reset before every command, so three is the minimum).
+ */
+static int w1_read_result(int fd, float *temp_out, int *millideg_out)
 {
-    int fd = w1_open_rw(device_id);
-    if (fd < 0) {
-        fprintf(stderr, "Cannot open rw for %s: %s\n", device_id, strerror(errno));
+    uint8_t raw_temp, count_remain, count_per_c;
+    if (w1_command(fd, DS1821_CMD_READ_TEMP, &raw_temp, 1) < 0 ||
+        w1_command(fd, DS1821_CMD_READ_COUNTER, &count_remain, 1) < 0 ||
+        w1_command(fd, DS1821_CMD_READ_SLOPE, &count_per_c, 1) < 0)
         return -1;
-    }
 
+    /* Compute high-resolution temperature */
+    int8_t temp_int = (int8_t)raw_temp;
+    int cpc = count_per_c ? count_per_c : 1;
+
+    *temp_out = (float)temp_int - 0.25f +
+                (float)(cpc - count_remain) / (float)cpc;
+
+    *millideg_out = (int)temp_int * 1000 - 250 +
+                    ((int)(cpc - count_remain) * 1000) / cpc;
+
+    return 0;
+}
+
+/*
+ * Read temperature over an already-open "rw" fd: Start Convert, wait
+ * for DONE, then read the three registers.
+ */
+static int read_hw_temperature(int fd, float *temp_out, int *millideg_out,
+                               long *conv_us_out, struct stamp *at)
+{
     /* Step 1: Start Convert T (0xEE) */
-    if (w1_command(fd, DS1821_CMD_START_CONVERT, NULL, 0) < 0) {
-        close(fd);
+    if (w1_command(fd, DS1821_CMD_START_CONVERT, NULL, 0) < 0)
         return -1;
-    }
 
     /* Wait for conversion — DS1821 takes up to 1 second */
-    printf("  Converting...");
-    fflush(stdout);
-    usleep(1000000);  /* 1 second */
-    printf(" done\n");
-
-    /* Step 2: Read temperature register (0xAA → 1 byte) */
-    uint8_t raw_temp;
-    if (lseek(fd, 0, SEEK_SET) < 0 ||
-        write(fd, (uint8_t[]){DS1821_CMD_READ_TEMP}, 1) != 1) {
-        perror("write READ_TEMP");
-        close(fd);
-        return -1;
+    if (out_format == OUT_TEXT) {
+        printf("  Converting...");
+        fflush(stdout);
     }
-    usleep(10000);
-    if (read(fd, &raw_temp, 1) != 1) {
-        perror("read temperature");
-        close(fd);
-        return -1;
+    long conv_us = w1_wait_convert(&fd, 1);
+    stamp_now(at);
+    if (out_format == OUT_TEXT)
+        printf(" done (%ld ms)\n", conv_us / 1000);
+    *conv_us_out = conv_us;
+
+    /* Steps 2-4: temperature, COUNT_REMAIN, COUNT_PER_C */
+    return w1_read_result(fd, temp_out, millideg_out);
+}
+
+/* ── Machine-readable output (--format) ──────────────────────────── */
+
+/*
+ * One line per sample, flushed as it is written (stdout is line
+ * buffered), with no decoration.  Both timestamps are taken when the
+ * conversion wait ends: mono_ns from CLOCK_MONOTONIC for intervals,
+ * wall_ns from CLOCK_REALTIME for the collector.  A failed read keeps
+ * its line, with millideg and conv_us empty (CSV) or an "error" key
+ * (NDJSON).
+ *
+ *   mono_ns,wall_ns,master,device,millideg,conv_us
+ *   {"mono_ns":...,"wall_ns":...,"master":"w1_bus_master1","device":"22-...","millideg":21500,"conv_us":612000}
+ */
+
+static void emit_header(void)
+{
+    if (out_format == OUT_CSV)
+        printf("mono_ns,wall_ns,master,device,millideg,conv_us\n");
+}
+
+/* master may be NULL (single-device mode) */
+static void emit_sample(const struct stamp *st, const char *master, const char *dev,
+                        int ok, int millideg, long conv_us)
+{
+    if (out_format == OUT_CSV) {
+        printf("%lld,%lld,%s,%s,", st->mono_ns, st->wall_ns, master ? master : "", dev);
+        if (ok)
+            printf("%d,%ld\n", millideg, conv_us);
+        else
+            printf(",\n");
+        return;
     }
 
-    /* Step 3: Read COUNT_REMAIN (0xA0 → 1 byte) */
-    uint8_t count_remain;
-    if (lseek(fd, 0, SEEK_SET) < 0 ||
-        write(fd, (uint8_t[]){DS1821_CMD_READ_COUNTER}, 1) != 1) {
-        perror("write READ_COUNTER");
-        close(fd);
+    printf("{\"mono_ns\":%lld,\"wall_ns\":%lld,", st->mono_ns, st->wall_ns);
+    if (master)
+        printf("\"master\":\"%s\",", master);
+    printf("\"device\":\"%s\",", dev);
+    if (ok)
+        printf("\"millideg\":%d,\"conv_us\":%ld}\n", millideg, conv_us);
+    else
+        printf("\"error\":\"read failed\"}\n");
+}
+
+/* ── Read every DS1821 on every master (--all) ───────────────────── */
+
+/*
+ * Devices grouped by bus master.  Each master gets its own worker
+ * thread, and all devices on one master share a conversion window, so
+ * a scan takes as long as the busiest bus rather than the sum of all.
+ */
+struct w1_bus {
+    char      master[256];
+    int       n_dev;
+    char      dev[MAX_BUS_DEVICES][256];
+    int       fd[MAX_BUS_DEVICES];      /* held open across --loop */
+    int       ok[MAX_BUS_DEVICES];
+    float     temp[MAX_BUS_DEVICES];
+    int       millideg[MAX_BUS_DEVICES];
+    long      conv_us;
+    struct stamp at;                    /* when the conversion wait ended */
+    pthread_t thread;
+};
+
+static struct w1_bus buses[MAX_MASTERS];
+static int n_buses = 0;
+
+/*
+ * Enumerate W1_DEVICES_DIR/w1_bus_masterN/22-* for every master.
+ * Returns the total number of DS1821s found, or -1 on error.
+ */
+static int find_all_ds1821(void)
+{
+    DIR *dir = opendir(W1_DEVICES_DIR);
+    struct dirent *ent;
+    int total = 0;
+
+    if (!dir) {
+        fprintf(stderr, "Cannot open %s: %s\n"
+                "  Is the w1 bus master loaded?\n",
+                W1_DEVICES_DIR, strerror(errno));
         return -1;
     }
-    usleep(10000);
-    if (read(fd, &count_remain, 1) != 1) {
-        perror("read counter");
-        close(fd);
-        return -1;
+
+    while ((ent = readdir(dir)) != NULL && n_buses < MAX_MASTERS) {
+        if (strncmp(ent->d_name, W1_MASTER_PREFIX, strlen(W1_MASTER_PREFIX)) != 0)
+            continue;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", W1_DEVICES_DIR, ent->d_name);
+        DIR *mdir = opendir(path);
+        if (!mdir)
+            continue;
+
+        struct w1_bus *bus = &buses[n_buses];
+        memset(bus, 0, sizeof(*bus));
+        snprintf(bus->master, sizeof(bus->master), "%s", ent->d_name);
+
+        struct dirent *sent;
+        while ((sent = readdir(mdir)) != NULL && bus->n_dev < MAX_BUS_DEVICES) {
+            if (strncmp(sent->d_name, DS1821_FAMILY "-", 3) == 0) {
+                snprintf(bus->dev[bus->n_dev], sizeof(bus->dev[0]), "%s", sent->d_name);
+                bus->fd[bus->n_dev] = -1;
+                bus->n_dev++;
+            }
+        }
+        closedir(mdir);
+
+        if (bus->n_dev > 0) {
+            total += bus->n_dev;
+            n_buses++;
+        }
     }
 
-    /* Step 4: Read COUNT_PER_C (0xA9 → 1 byte) */
-    uint8_t count_per_c;
-    if (lseek(fd, 0, SEEK_SET) < 0 ||
-        write(fd, (uint8_t[]){DS1821_CMD_READ_SLOPE}, 1) != 1) {
-        perror("write READ_SLOPE");
-        close(fd);
-        return -1;
+    closedir(dir);
+
+    if (total == 0)
+        fprintf(stderr, "No DS1821 (family %s) found on any w1 master.\n", DS1821_FAMILY);
+    return total;
+}
+
+/* Worker: one conversion window for every device on this master */
+static void *bus_worker(void *arg)
+{
+    struct w1_bus *bus = arg;
+    int fds[MAX_BUS_DEVICES], idx[MAX_BUS_DEVICES], n = 0;
+
+    for (int i = 0; i < bus->n_dev; i++) {
+        bus->ok[i] = 0;
+        if (bus->fd[i] < 0 && (bus->fd[i] = w1_open_rw(bus->dev[i])) < 0)
+            continue;
+        if (w1_command(bus->fd[i], DS1821_CMD_START_CONVERT, NULL, 0) == 0) {
+            fds[n] = bus->fd[i];
+            idx[n++] = i;
+        }
     }
-    usleep(10000);
-    if (read(fd, &count_per_c, 1) != 1) {
-        perror("read slope");
-        close(fd);
-        return -1;
+
+    bus->conv_us = n ? w1_wait_convert(fds, n) : 0;
+    stamp_now(&bus->at);
+
+    for (int k = 0; k < n; k++) {
+        int i = idx[k];
+        bus->ok[i] = (w1_read_result(bus->fd[i], &bus->temp[i], &bus->millideg[i]) == 0);
     }
 
-    close(fd);
+    /* Drop fds that failed so the next cycle reopens them */
+    for (int i = 0; i < bus->n_dev; i++) {
+        if (!bus->ok[i] && bus->fd[i] >= 0) {
+            close(bus->fd[i]);
+            bus->fd[i] = -1;
+        }
+    }
 
-    /* Step 5: Compute high-resolution temperature */
-    int8_t temp_int = (int8_t)raw_temp;
-    int cpc = count_per_c ? count_per_c : 1;
+    return NULL;
+}
 
-    *temp_out = (float)temp_int - 0.25f +
-                (float)(cpc - count_remain) / (float)cpc;
+/*
+ * Run one worker per master in parallel, then print the results.
+ * Returns the number of devices that failed.
+ */
+static int read_all(void)
+{
+    int errors = 0;
+    int spawned[MAX_MASTERS];
 
-    *millideg_out = (int)temp_int * 1000 - 250 +
-                    ((int)(cpc - count_remain) * 1000) / cpc;
+    for (int b = 0; b < n_buses; b++) {
+        spawned[b] = (pthread_create(&buses[b].thread, NULL, bus_worker, &buses[b]) == 0);
+        if (!spawned[b])
+            bus_worker(&buses[b]);  /* couldn't spawn — read it inline */
+    }
 
-    return 0;
+    for (int b = 0; b < n_buses; b++)
+        if (spawned[b])
+            pthread_join(buses[b].thread, NULL);
+
+    if (out_format != OUT_TEXT) {
+        for (int b = 0; b < n_buses; b++) {
+            struct w1_bus *bus = &buses[b];
+            for (int i = 0; i < bus->n_dev; i++) {
+                emit_sample(&bus->at, bus->master, bus->dev[i], bus->ok[i],
+                            bus->millideg[i], bus->conv_us);
+                errors += !bus->ok[i];
+            }
+        }
+        return errors;
+    }
+
+    time_t now = time(NULL);
+    char ts[32];
+    strftime(ts, sizeof(ts), "%H:%M:%S", localtime(&now));
+
+    for (int b = 0; b < n_buses; b++) {
+        struct w1_bus *bus = &buses[b];
+        printf("  %s (conversion %ld ms)\n", bus->master, bus->conv_us / 1000);
+        for (int i = 0; i < bus->n_dev; i++) {
+            if (bus->ok[i]) {
+                printf("    [%s]  %s  %.2f °C  (%d m°C)\n", ts, bus->dev[i],
+                       bus->temp[i], bus->millideg[i]);
+            } else {
+                printf("    [%s]  %s  read failed\n", ts, bus->dev[i]);
+                errors++;
+            }
+        }
+    }
+
+    return errors;
 }
 
 /* ── Pretty-print ────────────────────────────────────────────────── */
@@ -235,6 +488,49 @@ static void print_temp(float temp_c, int millideg)
     printf("  [%s]  %.2f °C  (%d m°C)\n", ts, temp_c, millideg);
 }
 
+/* ── Fixed-rate loop (--loop) ────────────────────────────────────── */
+
+/*
+ * --loop N runs on a grid of ticks N s apart, anchored at the first
+ * sample, rather than sleeping N s after each read (which drifts by
+ * the read time every cycle).  Each conversion is started early by the
+ * last measured conversion time, so DONE lands on the tick.  Ticks
+ * already gone by when a read ends are skipped, not made up.
+ */
+static long long loop_period_ns;
+static long long loop_tick_ns;                  /* 0 until the first sample */
+static long loop_lead_us = CONVERT_TIMEOUT_US;
+
+static void sleep_until_ns(long long t)
+{
+    struct timespec ts = { .tv_sec = t / 1000000000LL, .tv_nsec = t % 1000000000LL };
+
+    while (keep_running &&
+           clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/*
+ * Sleep until the next conversion must start.  sampled_ns is when the
+ * last conversion ended and conv_us how long it took (0 if it failed).
+ */
+static void loop_wait(long long sampled_ns, long conv_us)
+{
+    if (conv_us > 0)
+        loop_lead_us = conv_us;
+
+    if (loop_tick_ns == 0)
+        loop_tick_ns = sampled_ns;
+
+    long long lead_ns = loop_lead_us * 1000LL;
+    long long now = clock_ns(CLOCK_MONOTONIC);
+    do
+        loop_tick_ns += loop_period_ns;
+    while (loop_tick_ns - lead_ns < now);
+
+    sleep_until_ns(loop_tick_ns - lead_ns);
+}
+
 /* ── Usage ───────────────────────────────────────────────────────── */
 
 static void usage(const char *prog)
@@ -243,12 +539,17 @@ static void usage(const char *prog)
            "Read temperature from a DS1821 1-Wire sensor.\n\n"
            "Options:\n"
            "  --loop [N]      Read continuously every N seconds (default: 2)\n"
+           "  --all           Read every DS1821 on every w1 master in parallel\n"
+           "  --format F      Machine output, one line-buffered line per sample:\n"
+           "                  csv or json (NDJSON), with monotonic and wall ns\n"
            "  --help          Show this help\n\n"
            "Examples:\n"
            "  %s                          Auto-detect DS1821 on bus\n"
            "  %s 22-0123456789ab          Read specific device\n"
-           "  %s --loop 1                 Continuous reading every second\n",
-           prog, prog, prog, prog);
+           "  %s --loop 1                 Continuous reading every second\n"
+           "  %s --all --loop 10          All sensors, every 10 seconds\n"
+           "  %s --all --loop 5 --format json | collector\n",
+           prog, prog, prog, prog, prog, prog);
 }
 
 /* ── main ────────────────────────────────────────────────────────── */
@@ -257,6 +558,7 @@ int main(int argc, char *argv[])
 {
     int loop_mode = 0;
     int loop_sec = 2;
+    int all_mode = 0;
     const char *device_id = NULL;
 
     /* Parse args */
@@ -267,6 +569,20 @@ int main(int argc, char *argv[])
                 loop_sec = atoi(argv[++i]);
                 if (loop_sec < 1) loop_sec = 1;
             }
+        } else if (strcmp(argv[i], "--all") == 0) {
+            all_mode = 1;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *f = argv[++i];
+            if (strcmp(f, "csv") == 0) {
+                out_format = OUT_CSV;
+            } else if (strcmp(f, "json") == 0) {
+                out_format = OUT_JSON;
+            } else if (strcmp(f, "text") == 0) {
+                out_format = OUT_TEXT;
+            } else {
+                fprintf(stderr, "Unknown format: %s (csv, json or text)\n", f);
+                return 1;
+            }
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             usage(argv[0]);
             return 0;
@@ -280,43 +596,108 @@ int main(int argc, char *argv[])
     }
 
     signal(SIGINT, sigint_handler);
+    loop_period_ns = loop_sec * 1000000000LL;
+
+    int text = (out_format == OUT_TEXT);
+    if (text) {
+        printf("DS1821 Temperature Reader\n");
+        printf("─────────────────────────\n");
+    } else {
+        setvbuf(stdout, NULL, _IOLBF, 0);
+    }
 
-    printf("DS1821 Temperature Reader\n");
-    printf("─────────────────────────\n");
+    if (all_mode) {
+        if (text)
+            printf("Scanning all w1 masters for DS1821 devices...\n");
+        int total = find_all_ds1821();
+        if (total <= 0)
+            return 1;
+        if (text)
+            printf("Found %d device(s) on %d master(s)\n\n", total, n_buses);
+        emit_header();
 
-    {
+        do {
+            int errors = read_all();
+            if (errors && !loop_mode)
+                return 1;
+
+            if (loop_mode && keep_running) {
+                /* Pace on the slowest master */
+                long long sampled_ns = 0;
+                long conv_us = 0;
+                for (int b = 0; b < n_buses; b++) {
+                    if (buses[b].at.mono_ns > sampled_ns)
+                        sampled_ns = buses[b].at.mono_ns;
+                    if (buses[b].conv_us > conv_us)
+                        conv_us = buses[b].conv_us;
+                }
+                if (text)
+                    printf("\n");
+                loop_wait(sampled_ns, conv_us);
+            }
+        } while (loop_mode && keep_running);
+    } else {
         /* Real hardware path */
         char dev_id[256];
 
         if (device_id) {
             snprintf(dev_id, sizeof(dev_id), "%s", device_id);
         } else {
-            printf("Scanning for DS1821 devices...\n");
+            if (text)
+                printf("Scanning for DS1821 devices...\n");
             if (find_ds1821(dev_id, sizeof(dev_id)) < 0) {
                 return 1;
             }
         }
 
-        printf("Device: %s\n\n", dev_id);
+        if (text)
+            printf("Device: %s\n\n", dev_id);
+        emit_header();
+
+        /* Held open across --loop iterations; reopened after a failure */
+        int fd = -1;
 
         do {
             float temp;
             int millideg;
-            if (read_hw_temperature(dev_id, &temp, &millideg) == 0) {
+            long conv_us = 0;
+            struct stamp at;
+
+            if (fd < 0 && (fd = w1_open_rw(dev_id)) < 0)
+                fprintf(stderr, "Cannot open rw for %s: %s\n", dev_id, strerror(errno));
+
+            stamp_now(&at);                 /* overwritten when the wait ends */
+            int ok = (fd >= 0 &&
+                      read_hw_temperature(fd, &temp, &millideg, &conv_us, &at) == 0);
+
+            if (!text) {
+                emit_sample(&at, NULL, dev_id, ok, millideg, conv_us);
+            } else if (ok) {
                 print_temp(temp, millideg);
             } else {
                 fprintf(stderr, "  Read failed\n");
+            }
+
+            if (!ok) {
+                if (fd >= 0) {
+                    close(fd);
+                    fd = -1;
+                }
                 if (!loop_mode) return 1;
             }
 
             if (loop_mode && keep_running) {
-                printf("\n");
-                sleep(loop_sec);
+                if (text)
+                    printf("\n");
+                loop_wait(at.mono_ns, ok ? conv_us : 0);
             }
         } while (loop_mode && keep_running);
+
+        if (fd >= 0)
+            close(fd);
     }
 
-    if (!keep_running)
+    if (!keep_running && text)
         printf("\nInterrupted.\n");
 
     return 0;
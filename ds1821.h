@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * ds1821.h — libds1821, in-process access to DS1821 thermostats
+ *
+ * The same bus code as the ds1821 tool, built as a shared library
+ * (libds1821.so) so a service can read sensors without forking the CLI
+ * and parsing its output.  Nothing is printed to stdout; problems are
+ * reported on stderr and by a -1 return.
+ *
+ * Blocking read of one sensor:
+ *
+ *     struct ds1821_config cfg = DS1821_CONFIG_INIT(17);
+ *     struct ds1821_reading r;
+ *     ds1821_init(NULL, 0);
+ *     struct ds1821 *d = ds1821_open(&cfg);
+ *     if (d && ds1821_read(d, &r) == 0)
+ *         printf("%d m°C\n", r.millideg);
+ *     ds1821_close(d);
+ *     ds1821_exit();
+ *
+ * Non-blocking: ds1821_start_conversion(), then ds1821_poll() from your
+ * own event loop until it returns 1, then ds1821_fetch().  Start several
+ * sensors before polling any of them and their conversions overlap.
+ * ds1821_read_batch() does exactly that for a list of handles.
+ *
+ * pigpio allows a single user per machine, so the library is for one
+ * process, and one thread at a time.  Link with -lds1821 -lpigpio.
+ */
+#ifndef DS1821_H
+#define DS1821_H
+
+#include <stdint.h>
+
+#define DS1821_API __attribute__((visibility("default")))
+
+/* ds1821_init() flags */
+#define DS1821_INIT_POLL_DONE  0x01  /* blocking waits end on DONE (--poll-done) */
+#define DS1821_INIT_VERBOSE    0x02  /* bus trace on stdout (-v) */
+
+/* One sensor: the same fields as a sensors.conf line */
+struct ds1821_config {
+    int data_pin;           /* 1-Wire data GPIO */
+    int power_pin;          /* GPIO driving VDD, -1 = none */
+    int read_tout;          /* sample DQ/TOUT before each reading */
+    int tx_pin;             /* wave engine open-drain driver, -1 = none */
+    int w1_master;          /* netlink engine: w1_bus_masterN */
+    const char *w1_device;  /* sysfs engine: slave ID, e.g. "22-0000012345" */
+    const char *timing;     /* bit-bang timing profile, NULL = standard */
+    int retries;            /* extra reads per register until two agree */
+};
+
+#define DS1821_CONFIG_INIT(pin) \
+    { .data_pin = (pin), .power_pin = -1, .read_tout = 0, .tx_pin = -1, \
+      .w1_master = 1, .w1_device = NULL, .timing = NULL, .retries = 2 }
+
+/*
+ * One complete set of values from a conversion: everything the status
+ * action prints and the daemon publishes.
+ */
+struct ds1821_reading {
+    uint8_t status;
+    int8_t  temp;
+    uint8_t count_remain;
+    uint8_t count_per_c;
+    int     millideg;
+    int8_t  th, tl;
+    int     have_th;
+    int     tout;       /* -1 if read_tout not set */
+    long    conv_us;    /* Measured conversion wait */
+};
+
+struct ds1821;          /* opaque handle */
+
+/*
+ * Select the 1-Wire engine ("bitbang", "wave", "netlink", "sysfs", or
+ * "sim" for simulated parts in virtual time; NULL for bitbang) and start
+ * pigpio if it needs it.  Returns 0 or -1.
+ */
+DS1821_API int  ds1821_init(const char *engine, int flags);
+DS1821_API void ds1821_exit(void);
+
+/* Returns NULL if the config is invalid or out of memory */
+DS1821_API struct ds1821 *ds1821_open(const struct ds1821_config *cfg);
+DS1821_API void ds1821_close(struct ds1821 *d);
+
+/* Send Start Convert and return at once.  Returns 0 or -1. */
+DS1821_API int  ds1821_start_conversion(struct ds1821 *d);
+
+/*
+ * Check a started conversion without waiting: at most one status
+ * register read.  Returns 1 when done, 0 while converting, -1 if no
+ * conversion was started.
+ */
+DS1821_API int  ds1821_poll(struct ds1821 *d);
+
+/*
+ * Read the result of a finished conversion.  Returns 0, or -1 (errno
+ * EAGAIN if the conversion is still running).
+ */
+DS1821_API int  ds1821_fetch(struct ds1821 *d, struct ds1821_reading *out);
+
+/* Start, wait and fetch.  Returns 0 or -1. */
+DS1821_API int  ds1821_read(struct ds1821 *d, struct ds1821_reading *out);
+
+/*
+ * Read n sensors with one shared conversion wait.  ok[i] is set for
+ * each sensor read; returns the number that failed, or -1 if n is
+ * larger than the library supports.
+ */
+DS1821_API int  ds1821_read_batch(struct ds1821 *const *devs, int n,
+                                  struct ds1821_reading *out, int *ok);
+
+/* Program TH and TL into EEPROM.  Returns 0 or -1. */
+DS1821_API int  ds1821_set_thresholds(struct ds1821 *d, int th, int tl);
+
+#endif /* DS1821_H */
@@ -17,23 +17,59 @@
  *   3. Power-cycle the DS1821
  *   4. The DS1821 will now appear as family 0x22
  *
+ * Daemon mode (ds1821d, or the "daemon" action) reads every sensor in
+ * /etc/ds1821/sensors.conf on a fixed interval and keeps pigpio and
+ * the sensor power pins held for its whole lifetime, so each cycle
+ * only costs bus time.  Start Convert is sent to every bus before a
+ * single shared conversion wait.
+ *
+ * Built with -DDS1821_LIB this file is libds1821 instead: no main(),
+ * and only the API in ds1821.h is exported (see the Makefile).
+ *
  * Build:  gcc -Wall -o ds1821_program ds1821_program.c -lpigpio -lrt -lpthread
  * Run:    sudo ./ds1821_program [options]
  *
  * Must be run as root.
  */
 
-#define _DEFAULT_SOURCE  /* for usleep() */
+#define _GNU_SOURCE      /* usleep(), pthread_setaffinity_np() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include <poll.h>
+#include <netdb.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
 #include <pigpio.h>
 
+#include "ds1821.h"
+#include "ds1821_shm.h"
+
 /* ── Configuration ───────────────────────────────────────────────── */
 #define DEFAULT_GPIO_PIN   17     /* Default 1-Wire data GPIO pin   */
 #define DEFAULT_POWER_PIN  -1     /* GPIO pin powering DS1821 VDD   */
+#define DEFAULT_CONFIG     "/etc/ds1821/sensors.conf"
+#define DEFAULT_RUN_DIR    "/run/ds1821"
+#define DEFAULT_CACHE_DIR  "/var/cache/ds1821"
+#define DEFAULT_HISTORY_DIR "/var/lib/ds1821"
+#define LOCK_DIR           "/run/lock/ds1821"
+#define DEFAULT_INTERVAL   60     /* Daemon poll interval (seconds) */
+#define MAX_SENSORS        32
 
 /* ── DS1821 Commands (same as ds1821.h) ──────────────────────────── */
 #define DS1821_CMD_START_CONVERT  0xEE
@@ -53,11 +89,14 @@
 #define DS1821_STATUS_THF    0x40
 #define DS1821_STATUS_TLF    0x20
 #define DS1821_STATUS_NVB    0x10
+#define DS1821_STATUS_POL    0x02
 #define DS1821_STATUS_1SHOT  0x01
+#define DS1821_STATUS_CONFIG (DS1821_STATUS_POL | DS1821_STATUS_1SHOT)
 
 /* 1-Wire ROM commands */
 #define OW_CMD_READ_ROM    0x33
 #define OW_CMD_SKIP_ROM    0xCC
+#define OW_CMD_MATCH_ROM   0x55
 #define OW_CMD_SEARCH_ROM  0xF0
 
 /* ── 1-Wire Timing (microseconds) ────────────────────────────────── */
@@ -79,11 +118,73 @@
 
 #define OW_RECOVERY_US        2     /* Inter-slot recovery */
 
+/*
+ * Bit-bang timing profiles (all in µs).  "standard" is the table above.
+ * "tight" trims each slot to just over the 60 µs minimum plus 1 µs of
+ * recovery and samples reads earlier; it suits short, clean lines.
+ * "long" adds recovery time for long or heavily loaded lines where the
+ * pull-up is slow to bring DQ back high.  The DS1821 has no overdrive
+ * speed, so there is no overdrive profile.  The wave engine always uses
+ * the standard values.
+ */
+struct ow_timing {
+    const char *name;
+    int reset_low, reset_release, reset_presence;
+    int write1_low, write1_release;
+    int write0_low, write0_release;
+    int read_low, read_sample, read_slot;
+    int recovery;
+};
+
+static const struct ow_timing ow_timings[] = {
+    { "standard", OW_RESET_LOW_US, OW_RESET_RELEASE_US, OW_RESET_PRESENCE_US,
+                  OW_WRITE1_LOW_US, OW_WRITE1_RELEASE_US,
+                  OW_WRITE0_LOW_US, OW_WRITE0_RELEASE_US,
+                  OW_READ_LOW_US, OW_READ_SAMPLE_US, OW_READ_SLOT_US,
+                  OW_RECOVERY_US },
+    { "tight",    480, 70, 410,   2, 58,   60,  1,   2, 6, 52,   1 },
+    { "long",     480, 70, 410,   6, 64,   60, 10,   6, 9, 55,  10 },
+};
+
+static const struct ow_timing *tm = &ow_timings[0];
+
+static const struct ow_timing *find_timing(const char *name)
+{
+    for (size_t i = 0; i < sizeof(ow_timings) / sizeof(ow_timings[0]); i++)
+        if (strcmp(ow_timings[i].name, name) == 0)
+            return &ow_timings[i];
+    return NULL;
+}
+
+/* ── Conversion wait ─────────────────────────────────────────────── */
+#define CONVERT_TIMEOUT_US    1000000  /* Datasheet max conversion time */
+#define CONVERT_POLL_FIRST_US 100000   /* First DONE poll after Start Convert */
+#define CONVERT_POLL_MIN_US   10000    /* Poll interval, doubling ... */
+#define CONVERT_POLL_MAX_US   80000    /* ... up to this */
+
 static int gpio_pin = DEFAULT_GPIO_PIN;
 static int power_pin = DEFAULT_POWER_PIN;  /* -1 = not used */
 static int read_tout_flag = 0;             /* --read-tout: check DQ/TOUT state */
 static int verbose = 0;
 static int quiet = 0;   /* --quick: minimal output for scripting */
+static int poll_done = 0;  /* --poll-done: end conversion wait on DONE */
+static int use_pigpio = 1; /* 0 when the engine and pins need no GPIO access */
+
+static volatile int keep_running = 1;
+
+static volatile int cache_flush = 0;    /* SIGHUP: re-read cached TH/TL */
+
+static void sigterm_handler(int sig)
+{
+    (void)sig;
+    keep_running = 0;
+}
+
+static void sighup_handler(int sig)
+{
+    (void)sig;
+    cache_flush = 1;
+}
 
 /* ── Low-level 1-Wire bit-bang ───────────────────────────────────── */
 
@@ -120,17 +221,17 @@ static int ow_reset(void)
 
     /* Pull low for reset duration */
     ow_drive_low();
-    gpioDelay(OW_RESET_LOW_US);
+    gpioDelay(tm->reset_low);
 
     /* Release and wait for device to respond */
     ow_release();
-    gpioDelay(OW_RESET_RELEASE_US);
+    gpioDelay(tm->reset_release);
 
     /* Sample: device pulls low during presence pulse */
     presence = !ow_read_bit_raw();  /* low = present */
 
     /* Wait out the rest of the reset window */
-    gpioDelay(OW_RESET_PRESENCE_US);
+    gpioDelay(tm->reset_presence);
 
     if (verbose)
         printf("  [OW] Reset: presence %s\n", presence ? "DETECTED" : "not detected");
@@ -146,17 +247,17 @@ static void ow_write_bit(int bit)
     if (bit) {
         /* Write 1: short low, long release */
         ow_drive_low();
-        gpioDelay(OW_WRITE1_LOW_US);
+        gpioDelay(tm->write1_low);
         ow_release();
-        gpioDelay(OW_WRITE1_RELEASE_US);
+        gpioDelay(tm->write1_release);
     } else {
         /* Write 0: long low, short release */
         ow_drive_low();
-        gpioDelay(OW_WRITE0_LOW_US);
+        gpioDelay(tm->write0_low);
         ow_release();
-        gpioDelay(OW_WRITE0_RELEASE_US);
+        gpioDelay(tm->write0_release);
     }
-    gpioDelay(OW_RECOVERY_US);
+    gpioDelay(tm->recovery);
 }
 
 /*
@@ -168,16 +269,16 @@ static int ow_read_bit(void)
 
     /* Initiate read slot with short low pulse */
     ow_drive_low();
-    gpioDelay(OW_READ_LOW_US);
+    gpioDelay(tm->read_low);
 
     /* Release and sample */
     ow_release();
-    gpioDelay(OW_READ_SAMPLE_US);
+    gpioDelay(tm->read_sample);
     bit = ow_read_bit_raw();
 
     /* Wait out rest of time slot */
-    gpioDelay(OW_READ_SLOT_US);
-    gpioDelay(OW_RECOVERY_US);
+    gpioDelay(tm->read_slot);
+    gpioDelay(tm->recovery);
 
     return bit;
 }
@@ -214,279 +315,1619 @@ static uint8_t ow_read_byte(void)
     return byte;
 }
 
-/* ── DS1821 high-level operations (thermostat mode — no ROM) ─────── */
+/* ── Wave (DMA-timed) 1-Wire engine ──────────────────────────────── */
 
 /*
- * In thermostat mode there is no ROM layer.  After reset + presence,
- * send the function command directly.
+ * The bit-bang engine above builds each slot from gpioSetMode() calls
+ * and gpioDelay() busy-waits, so it holds a core for the whole
+ * transaction and a preemption mid-slot stretches the timing.  This
+ * engine instead compiles a complete byte into a pigpio wave, which the
+ * DMA engine plays out with hardware timing while we sleep.
+ *
+ * A wave can only set and clear output levels, not switch a pin between
+ * input and output, so true open-drain needs a separate TX GPIO wired to
+ * pull DQ low (e.g. Schottky diode, cathode to TX).  With --tx-gpio the
+ * whole transaction — reset, writes and read slots — runs from waves,
+ * and DQ is sampled by pigpio's DMA level sampler via an alert
+ * callback.  Without a TX pin only write slots are waved: the master is
+ * the only driver during a write, so DQ can be pushed high and low
+ * directly.  Reset and read slots then fall back to bit-bang.
  */
 
-static int ds1821_read_status_reg(uint8_t *status)
+#define WAVE_MAX_EDGES   256
+#define WAVE_FLUSH_US    20000  /* Max wait for alert callbacks to catch up */
+
+static int tx_pin = -1;         /* --tx-gpio: open-drain driver for DQ */
+
+static volatile uint32_t wave_edge_tick[WAVE_MAX_EDGES];
+static volatile int      wave_edge_level[WAVE_MAX_EDGES];
+static volatile int      wave_n_edges;
+
+static void wave_alert(int gpio, int level, uint32_t tick)
 {
-    if (!ow_reset()) {
-        fprintf(stderr, "No presence pulse — check wiring!\n");
-        return -1;
-    }
-    ow_write_byte(DS1821_CMD_READ_STATUS);
-    *status = ow_read_byte();
-    return 0;
+    (void)gpio;
+    int n = wave_n_edges;
+    if (level > 1 || n >= WAVE_MAX_EDGES)
+        return;     /* watchdog timeout or buffer full */
+    wave_edge_tick[n] = tick;
+    wave_edge_level[n] = level;
+    __sync_synchronize();
+    wave_n_edges = n + 1;
 }
 
-static int ds1821_write_status_reg(uint8_t status)
+/*
+ * Append one slot to a pulse list: drive low for low_us, then release
+ * for release_us.
+ */
+static int wave_slot(gpioPulse_t *p, int n, uint32_t mask,
+                     uint32_t low_us, uint32_t release_us)
 {
-    if (!ow_reset()) {
-        fprintf(stderr, "No presence pulse — check wiring!\n");
+    p[n++] = (gpioPulse_t){ .gpioOn = 0, .gpioOff = mask, .usDelay = low_us };
+    p[n++] = (gpioPulse_t){ .gpioOn = mask, .gpioOff = 0, .usDelay = release_us };
+    return n;
+}
+
+/*
+ * Play a pulse list and sleep until the DMA engine has finished it.
+ * If expect_edges > 0, also wait for that many DQ edges to be
+ * delivered to wave_alert().  Returns 0 on success, -1 on error.
+ */
+static int wave_play(gpioPulse_t *p, int n, int expect_edges)
+{
+    gpioWaveAddNew();
+    if (gpioWaveAddGeneric(n, p) < 0)
+        return -1;
+    int id = gpioWaveCreate();
+    if (id < 0)
+        return -1;
+
+    if (gpioWaveTxSend(id, PI_WAVE_MODE_ONE_SHOT) < 0) {
+        gpioWaveDelete(id);
         return -1;
     }
-    ow_write_byte(DS1821_CMD_WRITE_STATUS);
-    ow_write_byte(status);
+    while (gpioWaveTxBusy())
+        usleep(100);
+    gpioWaveDelete(id);
 
-    /*
-     * After writing the status register, the device copies it to
-     * EEPROM.  The NVB flag will be set during the write.
-     * Per datasheet, EEPROM write takes up to 10ms, but we'll be
-     * generous.  During this time DQ must remain high (pulled up).
-     */
-    printf("  Waiting for EEPROM write...\n");
-    ow_release();
-    usleep(200000);  /* 200 ms, very generous */
+    /* Alerts are delivered from pigpio's sampler thread, slightly late */
+    for (int waited = 0; waited < WAVE_FLUSH_US &&
+                         wave_n_edges < expect_edges; waited += 500)
+        usleep(500);
 
     return 0;
 }
 
-/*
- * Try writing status register using Skip ROM first (proper 1-Wire addressing).
- * Some DS1821s in transitional state may need this.
- */
-static int ds1821_write_status_skiprom(uint8_t status)
+/* DQ level at `tick`, reconstructed from the sampled edge list */
+static int wave_level_at(uint32_t tick)
 {
-    if (!ow_reset()) {
-        fprintf(stderr, "No presence pulse!\n");
-        return -1;
+    int level = 1;  /* bus idles high */
+    for (int i = 0; i < wave_n_edges; i++) {
+        if ((int32_t)(wave_edge_tick[i] - tick) > 0)
+            break;
+        level = wave_edge_level[i];
     }
-    ow_write_byte(OW_CMD_SKIP_ROM);     /* Skip ROM — address all devices */
-    ow_write_byte(DS1821_CMD_WRITE_STATUS);
-    ow_write_byte(status);
+    return level;
+}
 
-    printf("  (Skip ROM) Waiting for EEPROM write...\n");
+/* Program the TX pin idle (released) and start sampling DQ */
+static void wave_arm(void)
+{
+    gpioSetMode(tx_pin, PI_OUTPUT);
+    gpioWrite(tx_pin, 1);
     ow_release();
-    usleep(200000);
+    wave_n_edges = 0;
+    gpioSetAlertFunc(gpio_pin, wave_alert);
+}
 
-    return 0;
+static void wave_disarm(void)
+{
+    gpioSetAlertFunc(gpio_pin, NULL);
 }
 
-static int ds1821_read_status_skiprom(uint8_t *status)
+static int wave_reset(void)
 {
-    if (!ow_reset()) return -1;
-    ow_write_byte(OW_CMD_SKIP_ROM);
-    ow_write_byte(DS1821_CMD_READ_STATUS);
-    *status = ow_read_byte();
-    return 0;
+    if (tx_pin < 0)
+        return ow_reset();
+
+    gpioPulse_t p[2];
+    int n = wave_slot(p, 0, 1u << tx_pin, OW_RESET_LOW_US,
+                      OW_RESET_RELEASE_US + OW_RESET_PRESENCE_US);
+
+    wave_arm();
+    int ret = wave_play(p, n, 4);   /* master low/high + presence low/high */
+    /* Sample where the bit-bang path would: RELEASE_US after release */
+    int presence = 0;
+    if (ret == 0 && wave_n_edges > 0)
+        presence = !wave_level_at(wave_edge_tick[0] + OW_RESET_LOW_US +
+                                  OW_RESET_RELEASE_US);
+    wave_disarm();
+
+    if (verbose)
+        printf("  [OW] Reset (wave): presence %s\n",
+               presence ? "DETECTED" : "not detected");
+
+    return presence;
 }
 
-static int ds1821_read_temperature(int8_t *temp)
+/*
+ * Read `nbits` slots in one wave.  Slots are DMA-timed, so slot k starts
+ * exactly k * slot_us after the first falling edge; each bit is DQ's
+ * level at the same sample point ow_read_bit() uses.
+ */
+static uint32_t wave_read_bits(int nbits)
 {
-    if (!ow_reset()) {
-        fprintf(stderr, "No presence pulse!\n");
-        return -1;
+    gpioPulse_t p[2 * 32];
+    uint32_t slot_us = OW_READ_LOW_US + OW_READ_SAMPLE_US +
+                       OW_READ_SLOT_US + OW_RECOVERY_US;
+    int n = 0;
+
+    for (int i = 0; i < nbits; i++)
+        n = wave_slot(p, n, 1u << tx_pin, OW_READ_LOW_US, slot_us - OW_READ_LOW_US);
+
+    wave_arm();
+    uint32_t bits = 0;
+    if (wave_play(p, n, 2 * nbits) == 0 && wave_n_edges > 0) {
+        uint32_t t0 = wave_edge_tick[0];
+        for (int i = 0; i < nbits; i++)
+            if (wave_level_at(t0 + i * slot_us + OW_READ_LOW_US + OW_READ_SAMPLE_US))
+                bits |= 1u << i;
+    } else {
+        bits = 0xFFFFFFFFu;     /* nothing sampled — reads as idle bus */
     }
-    ow_write_byte(DS1821_CMD_READ_TEMP);
-    *temp = (int8_t)ow_read_byte();
-    return 0;
+    wave_disarm();
+
+    return bits;
 }
 
-static int ds1821_read_counter(uint8_t *count_remain)
+/*
+ * Write `nbits` bits (LSB first) in one wave.  Without a TX pin, DQ is
+ * driven push-pull for the duration — safe because nothing else drives
+ * the bus during write slots.
+ */
+static void wave_write_bits(uint32_t bits, int nbits)
 {
-    if (!ow_reset()) return -1;
-    ow_write_byte(DS1821_CMD_READ_COUNTER);
-    *count_remain = ow_read_byte();
-    return 0;
+    gpioPulse_t p[2 * 32];
+    int pin = tx_pin >= 0 ? tx_pin : gpio_pin;
+    int n = 0;
+
+    for (int i = 0; i < nbits; i++) {
+        if (bits & (1u << i))
+            n = wave_slot(p, n, 1u << pin, OW_WRITE1_LOW_US,
+                          OW_WRITE1_RELEASE_US + OW_RECOVERY_US);
+        else
+            n = wave_slot(p, n, 1u << pin, OW_WRITE0_LOW_US,
+                          OW_WRITE0_RELEASE_US + OW_RECOVERY_US);
+    }
+
+    gpioWrite(pin, 1);
+    gpioSetMode(pin, PI_OUTPUT);
+    wave_play(p, n, 0);
+    if (tx_pin < 0)
+        ow_release();
 }
 
-static int ds1821_read_slope(uint8_t *count_per_c)
+static void wave_write_bit(int bit)
 {
-    if (!ow_reset()) return -1;
-    ow_write_byte(DS1821_CMD_READ_SLOPE);
-    *count_per_c = ow_read_byte();
-    return 0;
+    wave_write_bits(bit ? 1 : 0, 1);
 }
 
-static int ds1821_start_convert(void)
+static int wave_read_bit(void)
 {
-    if (!ow_reset()) return -1;
-    ow_write_byte(DS1821_CMD_START_CONVERT);
-    return 0;
+    if (tx_pin < 0)
+        return ow_read_bit();
+    return wave_read_bits(1) & 1;
 }
 
-static int ds1821_read_th(int8_t *th)
+static void wave_write_byte(uint8_t byte)
 {
-    if (!ow_reset()) return -1;
-    ow_write_byte(DS1821_CMD_READ_TH);
-    *th = (int8_t)ow_read_byte();
-    return 0;
+    if (verbose)
+        printf("  [OW] Write (wave): 0x%02X\n", byte);
+    wave_write_bits(byte, 8);
 }
 
-static int ds1821_read_tl(int8_t *tl)
+static uint8_t wave_read_byte(void)
 {
-    if (!ow_reset()) return -1;
-    ow_write_byte(DS1821_CMD_READ_TL);
-    *tl = (int8_t)ow_read_byte();
-    return 0;
+    if (tx_pin < 0)
+        return ow_read_byte();
+
+    uint8_t byte = (uint8_t)wave_read_bits(8);
+    if (verbose)
+        printf("  [OW] Read (wave):  0x%02X\n", byte);
+    return byte;
 }
 
-static int ds1821_write_th(int8_t th)
+/* ── Kernel w1 netlink engine ────────────────────────────────────── */
+
+/*
+ * Drives the bus through a kernel w1 bus master (e.g. w1-gpio) using
+ * raw reset/write/read commands over the netlink connector.  The
+ * kernel does the slot timing, so this engine needs neither pigpio nor
+ * its exclusive lock, and it reaches thermostat-mode parts that the
+ * sysfs "rw" engine below and ds1821-read cannot (rw always sends
+ * MATCH ROM).
+ *
+ * The master's own periodic search should be turned off so it doesn't
+ * talk over us:  echo 0 > /sys/bus/w1/devices/w1_bus_masterN/w1_master_search
+ *
+ * The kernel has no single-bit commands, so Search ROM is unavailable
+ * on this engine.
+ */
+
+/* From drivers/w1/w1_netlink.h — not exported to userspace headers */
+#define W1_MASTER_CMD     4
+#define W1_CMD_READ       0
+#define W1_CMD_WRITE      1
+#define W1_CMD_RESET      5
+
+struct w1_netlink_msg {
+    uint8_t  type;
+    uint8_t  status;
+    uint16_t len;
+    union {
+        uint8_t id[8];
+        struct { uint32_t id; uint32_t res; } mst;
+    } id;
+    uint8_t  data[];
+};
+
+struct w1_netlink_cmd {
+    uint8_t  cmd;
+    uint8_t  res;
+    uint16_t len;
+    uint8_t  data[];
+};
+
+#define NL_MAX_DATA     16
+#define NL_BUF_SIZE     4096
+#define NL_TIMEOUT_MS   1000
+
+static int w1_master = 1;       /* --w1-master N: w1_bus_masterN */
+static int nl_sock = -1;
+static uint32_t nl_seq = 0;
+
+static int nl_open(void)
 {
-    if (!ow_reset()) {
-        fprintf(stderr, "No presence pulse!\n");
+    if (nl_sock >= 0)
+        return 0;
+
+    nl_sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+    if (nl_sock < 0) {
+        fprintf(stderr, "w1 netlink socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* Port id 0: let the kernel assign one; replies are unicast to it */
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    if (bind(nl_sock, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        fprintf(stderr, "w1 netlink bind: %s\n", strerror(errno));
+        close(nl_sock);
+        nl_sock = -1;
         return -1;
     }
-    ow_write_byte(DS1821_CMD_WRITE_TH);
-    ow_write_byte((uint8_t)th);
-    printf("  Waiting for EEPROM write...\n");
-    ow_release();
-    usleep(200000);  /* 200ms for EEPROM */
     return 0;
 }
 
-static int ds1821_write_tl(int8_t tl)
+/*
+ * Send one command to the w1 master.  If `wait` is set, block until the
+ * kernel replies: READ replies carry `len` bytes back into buf, RESET
+ * is sent with ack set so the kernel returns a status.
+ * Returns the kernel status (0 = ok) or -1 on a transport error.
+ */
+static int nl_cmd(uint8_t cmd, uint8_t *buf, uint16_t len, int wait)
 {
-    if (!ow_reset()) {
-        fprintf(stderr, "No presence pulse!\n");
+    uint8_t out[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(struct w1_netlink_msg) +
+                            sizeof(struct w1_netlink_cmd) + NL_MAX_DATA)];
+    uint8_t in[NL_BUF_SIZE];
+
+    if (len > NL_MAX_DATA || nl_open() < 0)
+        return -1;
+
+    memset(out, 0, sizeof(out));
+    struct nlmsghdr *nlh = (struct nlmsghdr *)out;
+    struct cn_msg *cn = NLMSG_DATA(nlh);
+    struct w1_netlink_msg *msg = (struct w1_netlink_msg *)cn->data;
+    struct w1_netlink_cmd *c = (struct w1_netlink_cmd *)msg->data;
+
+    c->cmd = cmd;
+    c->len = len;
+    if (cmd == W1_CMD_WRITE)
+        memcpy(c->data, buf, len);
+
+    msg->type = W1_MASTER_CMD;
+    msg->len = sizeof(*c) + len;
+    msg->id.mst.id = w1_master;
+
+    cn->id.idx = CN_W1_IDX;
+    cn->id.val = CN_W1_VAL;
+    cn->seq = ++nl_seq;
+    cn->ack = (cmd == W1_CMD_RESET);
+    cn->len = sizeof(*msg) + msg->len;
+
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*cn) + cn->len);
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_seq = nl_seq;
+
+    if (send(nl_sock, out, nlh->nlmsg_len, 0) < 0) {
+        fprintf(stderr, "w1 netlink send: %s\n", strerror(errno));
         return -1;
     }
-    ow_write_byte(DS1821_CMD_WRITE_TL);
-    ow_write_byte((uint8_t)tl);
-    printf("  Waiting for EEPROM write...\n");
-    ow_release();
-    usleep(200000);
-    return 0;
+    if (!wait)
+        return 0;
+
+    /* Replies to earlier fire-and-forget writes (errors only) are skipped */
+    for (;;) {
+        struct pollfd pfd = { .fd = nl_sock, .events = POLLIN };
+        if (poll(&pfd, 1, NL_TIMEOUT_MS) <= 0) {
+            fprintf(stderr, "w1 netlink: no reply from w1_bus_master%d\n", w1_master);
+            return -1;
+        }
+
+        ssize_t n = recv(nl_sock, in, sizeof(in), 0);
+        if (n < 0)
+            return -1;
+
+        for (struct nlmsghdr *h = (struct nlmsghdr *)in; NLMSG_OK(h, (size_t)n);
+             h = NLMSG_NEXT(h, n)) {
+            struct cn_msg *rc = NLMSG_DATA(h);
+            if (rc->id.idx != CN_W1_IDX || rc->seq != nl_seq ||
+                rc->len < sizeof(struct w1_netlink_msg))
+                continue;
+
+            struct w1_netlink_msg *rm = (struct w1_netlink_msg *)rc->data;
+            if (rm->status)
+                return rm->status;
+
+            struct w1_netlink_cmd *rcmd = (struct w1_netlink_cmd *)rm->data;
+            if (rm->len < sizeof(*rcmd) || rcmd->cmd != cmd)
+                continue;
+            if (cmd == W1_CMD_READ) {
+                if (rcmd->len != len)
+                    continue;
+                memcpy(buf, rcmd->data, len);
+            }
+            return 0;
+        }
+    }
 }
 
-/* ── Utility: print status register ──────────────────────────────── */
+static int nl_reset(void)
+{
+    /* w1_reset_bus() reports a missing presence pulse as an error */
+    int presence = (nl_cmd(W1_CMD_RESET, NULL, 0, 1) == 0);
 
-static void print_status(uint8_t s)
+    if (verbose)
+        printf("  [OW] Reset (w1_bus_master%d): presence %s\n", w1_master,
+               presence ? "DETECTED" : "not detected");
+    return presence;
+}
+
+static void nl_write_byte(uint8_t byte)
+{
+    if (verbose)
+        printf("  [OW] Write (netlink): 0x%02X\n", byte);
+    /* No reply needed: the master executes commands in order */
+    nl_cmd(W1_CMD_WRITE, &byte, 1, 0);
+}
+
+static uint8_t nl_read_byte(void)
+{
+    uint8_t byte = 0xFF;    /* idle bus if the read fails */
+    nl_cmd(W1_CMD_READ, &byte, 1, 1);
+    if (verbose)
+        printf("  [OW] Read (netlink):  0x%02X\n", byte);
+    return byte;
+}
+
+/* The kernel master idles the bus high on its own */
+static void nl_release(void)
 {
-    printf("  Status register: 0x%02X\n", s);
-    printf("    DONE  (bit 7): %d  — %s\n", !!(s & 0x80),
-           (s & 0x80) ? "conversion complete" : "conversion in progress");
-    printf("    THF   (bit 6): %d  — %s\n", !!(s & 0x40),
-           (s & 0x40) ? "HIGH alarm tripped" : "no high alarm");
-    printf("    TLF   (bit 5): %d  — %s\n", !!(s & 0x20),
-           (s & 0x20) ? "LOW alarm tripped" : "no low alarm");
-    printf("    NVB   (bit 4): %d  — %s\n", !!(s & 0x10),
-           (s & 0x10) ? "EEPROM write in progress" : "EEPROM idle");
-    printf("    POL   (bit 1): %d  — thermostat output polarity %s\n",
-           !!(s & 0x02), (s & 0x02) ? "active-high" : "active-low");
-    printf("    1SHOT (bit 0): %d  — %s mode\n", !!(s & 0x01),
-           (s & 0x01) ? "one-shot" : "continuous");
 }
 
+/* ── Kernel w1 sysfs "rw" engine ─────────────────────────────────── */
+
 /*
- * Read ROM — only works with a SINGLE 1-Wire device on the bus.
- * Returns the 8-byte ROM code (family + 48-bit serial + CRC).
+ * For DS1821s already switched to 1-Wire mode and bound by the kernel
+ * (family 22).  Each write() to /sys/bus/w1/devices/<id>/rw is one
+ * transaction, reset + MATCH ROM + our bytes, and a read() straight
+ * after continues it, so this engine works a whole transaction at a
+ * time rather than byte by byte.  Thermostat-mode parts have no ROM
+ * and need the netlink engine instead.
  */
-static int ow_read_rom(uint8_t rom[8])
+
+#define W1_DEVICES_DIR  "/sys/bus/w1/devices"
+
+static const char *w1_device = NULL;   /* --w1-device ID, e.g. 22-0000012345 */
+static int  rw_fd = -1;
+static char rw_fd_id[64];
+
+/* The open rw file for w1_device, reopened when the sensor changes */
+static int rw_open(void)
 {
-    if (!ow_reset()) {
-        printf("  No presence pulse.\n");
+    if (!w1_device) {
+        fprintf(stderr, "The sysfs engine needs --w1-device (or w1dev= in sensors.conf)\n");
         return -1;
     }
-    ow_write_byte(OW_CMD_READ_ROM);
-    for (int i = 0; i < 8; i++)
-        rom[i] = ow_read_byte();
-    return 0;
+    if (rw_fd >= 0 && strcmp(rw_fd_id, w1_device) == 0)
+        return rw_fd;
+    if (rw_fd >= 0)
+        close(rw_fd);
+
+    char path[512];
+    snprintf(path, sizeof(path), W1_DEVICES_DIR "/%s/rw", w1_device);
+    rw_fd = open(path, O_RDWR | O_CLOEXEC);
+    if (rw_fd < 0)
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    else
+        snprintf(rw_fd_id, sizeof(rw_fd_id), "%s", w1_device);
+    return rw_fd;
 }
 
-/*
- * CRC8 for 1-Wire ROM codes (polynomial x^8+x^5+x^4+1 = 0x131).
- */
-static uint8_t ow_crc8(const uint8_t *data, int len)
+/* "Presence" here means the kernel still has the slave bound */
+static int rw_reset(void)
 {
-    uint8_t crc = 0;
-    for (int i = 0; i < len; i++) {
-        uint8_t byte = data[i];
-        for (int j = 0; j < 8; j++) {
-            uint8_t mix = (crc ^ byte) & 0x01;
-            crc >>= 1;
-            if (mix) crc ^= 0x8C;
-            byte >>= 1;
-        }
-    }
-    return crc;
+    return rw_open() >= 0;
 }
 
-static void print_rom(const uint8_t rom[8])
+static int rw_txn(const uint8_t *wr, int nwr, uint8_t *rd, int nrd)
 {
-    printf("  ROM: ");
-    for (int i = 0; i < 8; i++)
-        printf("%02X", rom[i]);
+    int fd = rw_open();
+    if (fd < 0)
+        return -1;
+    if (nwr == 0)
+        return 0;
 
-    uint8_t crc = ow_crc8(rom, 7);
-    printf("  (family=0x%02X, CRC %s)\n", rom[0],
-           crc == rom[7] ? "OK" : "BAD");
+    if (lseek(fd, 0, SEEK_SET) < 0 || write(fd, wr, nwr) != nwr)
+        return -1;
+    if (nrd > 0 && read(fd, rd, nrd) != nrd)
+        return -1;
 
-    /* Identify known families */
-    switch (rom[0]) {
-    case 0x22: printf("         → Family 0x22 (DS1822 / DS1821 in 1-Wire mode)\n"); break;
-    case 0x10: printf("         → DS18S20 (thermometer)\n"); break;
-    case 0x28: printf("         → DS18B20 (thermometer)\n"); break;
-    case 0x3B: printf("         → DS1825 (thermometer)\n"); break;
-    case 0x42: printf("         → DS28EA00 (thermometer)\n"); break;
-    case 0x00: printf("         → Family 0 — likely thermostat-mode DS1821\n"); break;
-    default:   printf("         → Unknown family\n"); break;
-    }
+    if (verbose)
+        printf("  [OW] rw %s: cmd 0x%02X, %d byte(s) read\n", w1_device, wr[0], nrd);
+    return 0;
 }
 
+/* ── Simulated bus (--engine sim) ────────────────────────────────── */
+
 /*
- * 1-Wire Search ROM algorithm (per Maxim AN187).
- * Finds all devices on the bus and stores their 64-bit ROM codes.
- * Returns the number of devices found.
+ * A software DS1821 behind the same reset/bit/byte hooks as the GPIO
+ * engines, so the test suite and benchmarks run without hardware or
+ * root.  Each data pin has its own simulated part, as it would on real
+ * buses, and a power pin switches every part that was last used with it.
+ *
+ * The model covers what this tool relies on:
+ *
+ *   - the status register: DONE, THF/TLF (cleared by writing 0), NVB
+ *     while an EEPROM write runs, and POL/1SHOT
+ *   - TH, TL and the configuration bits in EEPROM
+ *   - Read Temperature, Read Counter and Read Slope, from which the
+ *     usual formula gives the simulated temperature to 10 m°C
+ *   - one-shot and continuous conversion; DONE sets at the end of each
+ *   - the two modes, chosen by 1SHOT at power-up as described at the top
+ *     of this file.  In thermostat mode the part takes a function
+ *     command straight after reset, starts converting on its own and
+ *     drives TOUT (--read-tout).  In 1-Wire mode it answers Read, Skip,
+ *     Match and Search ROM as family 0x22 and needs one of them first.
+ *
+ * Time is virtual: every bus wait (conversion, EEPROM, power-on, retry
+ * backoff) moves now_us() forward instead of sleeping, so a reading
+ * costs microseconds of CPU.  The daemon's interval is still real time.
+ *
+ *   --sim-temp C[:SWING[:PERIOD]]  C °C, plus a triangle wave of ±SWING
+ *                                  over PERIOD virtual seconds (600)
+ *   --sim-state FILE               keep EEPROM contents between runs
+ *   --sim-flip N                   invert about one read slot in N
  */
-static int ow_search_rom(uint8_t roms[][8], int max_devices)
-{
-    int device_count = 0;
-    int last_discrepancy = -1;
-    int done = 0;
 
+#define SIM_CONVERT_US   500000  /* conversion time (datasheet max 1 s) */
+#define SIM_EEPROM_US    8000    /* NVB after an EEPROM write (max 10 ms) */
+#define SIM_POR_US       2000    /* no presence pulse after VDD comes up */
+#define SIM_COUNT_PER_C  100     /* Read Slope */
+#define SIM_TH           25      /* blank EEPROM */
+#define SIM_TL           15
+
+enum sim_state { SIM_IDLE, SIM_ROM, SIM_MATCH, SIM_SEARCH, SIM_CMD, SIM_ARG, SIM_READ };
+
+struct sim_part {
+    int     pin;            /* data GPIO */
+    int     power_pin;      /* -1 = never seen with one */
+    int     powered;
+    long long por_us;       /* when VDD came up */
+    int     onewire;        /* 1-Wire mode, latched from 1SHOT at power-up */
     uint8_t rom[8];
-    memset(rom, 0, sizeof(rom));
 
-    while (!done && device_count < max_devices) {
-        if (!ow_reset()) {
-            if (device_count == 0)
-                printf("  No presence pulse on search.\n");
-            break;
-        }
+    uint8_t ee_config;      /* EEPROM: POL | 1SHOT */
+    int8_t  ee_th, ee_tl;
+    long long nvb_end_us;   /* EEPROM write in progress until then */
+
+    uint8_t flags;          /* DONE, THF, TLF */
+    int     converting, continuous;
+    long long conv_end_us;
+    int8_t  temp;
+    uint8_t count_remain;
+    int     tout;           /* thermostat output active */
+
+    enum sim_state state;   /* where the part is in the current transaction */
+    uint8_t cmd, shift;
+    int     nbits;
+    uint8_t out[8];
+    int     nout, outbit;
+    int     rombit, phase;  /* Match/Search ROM position */
+};
+
+static struct sim_part sim_parts[MAX_SENSORS];
+static int  n_sim_parts;
+static long long sim_skew_us;       /* virtual time added to now_us() */
+static int  sim_temp_mdeg = 21500;  /* --sim-temp */
+static int  sim_swing_mdeg = 0;
+static int  sim_period_s = 600;
+static const char *sim_state_path;  /* --sim-state FILE */
+static int  sim_flip = 0;           /* --sim-flip N, 0 = never */
+static unsigned int sim_rand = 1;
+
+static long long now_us(void);
+static uint8_t ow_crc8(const uint8_t *data, int len);
+
+static int parse_sim_temp(const char *arg)
+{
+    double c, swing = 0;
+    int period = sim_period_s;
 
-        ow_write_byte(OW_CMD_SEARCH_ROM);
+    if (sscanf(arg, "%lf:%lf:%d", &c, &swing, &period) < 1 || period < 1 ||
+        c < -55 || c > 125 || swing < 0) {
+        fprintf(stderr, "Bad --sim-temp: %s (C[:SWING[:PERIOD]])\n", arg);
+        return -1;
+    }
+    sim_temp_mdeg = (int)(c * 1000);
+    sim_swing_mdeg = (int)(swing * 1000);
+    sim_period_s = period;
+    return 0;
+}
 
-        int new_discrepancy = -1;
+/* The temperature at virtual time t */
+static int sim_temp_at(long long t)
+{
+    long long p = sim_period_s * 1000000LL;
+    long long q = (t % p) * 4;
+    long long v = q < 2 * p ? q - p : 3 * p - q;   /* -p .. p */
+    int m = sim_temp_mdeg + (int)(sim_swing_mdeg * v / p);
 
-        for (int bit_pos = 0; bit_pos < 64; bit_pos++) {
-            int byte_idx = bit_pos / 8;
-            int bit_mask = 1 << (bit_pos % 8);
+    return m < -55000 ? -55000 : m > 125000 ? 125000 : m;
+}
 
-            /* Read two bits: id_bit and cmp_bit */
-            int id_bit  = ow_read_bit();
-            int cmp_bit = ow_read_bit();
+/* Keep every part's EEPROM in sim_state_path, with lines for other pins kept */
+static void sim_state_save(void)
+{
+    char tmp[520], line[64];
 
-            if (id_bit && cmp_bit) {
-                /* No devices responding — error or done */
-                done = 1;
-                break;
-            }
+    if (!sim_state_path)
+        return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", sim_state_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return;
 
-            int dir;
-            if (id_bit != cmp_bit) {
-                /* All devices agree on this bit */
-                dir = id_bit;
-            } else {
-                /* Discrepancy — both 0 and 1 present */
-                if (bit_pos == last_discrepancy) {
-                    dir = 1;  /* Take the 1 branch this time */
-                } else if (bit_pos > last_discrepancy) {
-                    dir = 0;  /* Take the 0 branch first */
-                    new_discrepancy = bit_pos;
+    FILE *old = fopen(sim_state_path, "r");
+    while (old && fgets(line, sizeof(line), old)) {
+        int pin, k;
+        if (sscanf(line, "%d", &pin) != 1)
+            continue;
+        for (k = 0; k < n_sim_parts && sim_parts[k].pin != pin; k++)
+            ;
+        if (k == n_sim_parts)
+            fputs(line, f);
+    }
+    if (old)
+        fclose(old);
+
+    for (int i = 0; i < n_sim_parts; i++)
+        fprintf(f, "%d %d %d 0x%02X\n", sim_parts[i].pin, sim_parts[i].ee_th,
+                sim_parts[i].ee_tl, sim_parts[i].ee_config);
+
+    if (fclose(f) != 0 || rename(tmp, sim_state_path) != 0)
+        unlink(tmp);
+}
+
+static void sim_state_load(struct sim_part *p)
+{
+    char line[64];
+    FILE *f = sim_state_path ? fopen(sim_state_path, "r") : NULL;
+
+    while (f && fgets(line, sizeof(line), f)) {
+        int pin, th, tl;
+        unsigned int config;
+        if (sscanf(line, "%d %d %d %x", &pin, &th, &tl, &config) == 4 && pin == p->pin) {
+            p->ee_th = (int8_t)th;
+            p->ee_tl = (int8_t)tl;
+            p->ee_config = config & DS1821_STATUS_CONFIG;
+        }
+    }
+    if (f)
+        fclose(f);
+}
+
+/* One finished conversion at time t */
+static void sim_sample(struct sim_part *p, long long t)
+{
+    int x = sim_temp_at(t) + 250;
+    int whole = x >= 0 ? x / 1000 : -((999 - x) / 1000);
+
+    p->temp = (int8_t)whole;
+    p->count_remain = SIM_COUNT_PER_C - (x - whole * 1000) * SIM_COUNT_PER_C / 1000;
+    if (p->temp >= p->ee_th) {
+        p->flags |= DS1821_STATUS_THF;
+        p->tout = 1;
+    }
+    if (p->temp <= p->ee_tl) {
+        p->flags |= DS1821_STATUS_TLF;
+        p->tout = 0;
+    }
+}
+
+static void sim_power_up(struct sim_part *p, long long t)
+{
+    p->powered = 1;
+    p->por_us = t;
+    p->onewire = !!(p->ee_config & DS1821_STATUS_1SHOT);
+    p->flags = 0;
+    p->nvb_end_us = 0;
+    p->state = SIM_IDLE;
+    p->temp = 0;
+    p->count_remain = SIM_COUNT_PER_C;
+    p->tout = 0;
+
+    /* A thermostat runs on its own from power-up */
+    p->converting = p->continuous = !p->onewire;
+    p->conv_end_us = t + SIM_CONVERT_US;
+}
+
+/* Bring a part up to the current virtual time */
+static void sim_update(struct sim_part *p)
+{
+    long long now = now_us();
+
+    if (p->nvb_end_us && now >= p->nvb_end_us)
+        p->nvb_end_us = 0;
+    if (!p->converting || now < p->conv_end_us)
+        return;
+
+    if (p->continuous) {
+        long long last = p->conv_end_us +
+                         (now - p->conv_end_us) / SIM_CONVERT_US * SIM_CONVERT_US;
+        sim_sample(p, last);
+        p->conv_end_us = last + SIM_CONVERT_US;
+    } else {
+        sim_sample(p, p->conv_end_us);
+        p->converting = 0;
+    }
+    p->flags |= DS1821_STATUS_DONE;
+}
+
+/* The part on the current pin, created as if powered for a while */
+static struct sim_part *sim_part(void)
+{
+    for (int i = 0; i < n_sim_parts; i++)
+        if (sim_parts[i].pin == gpio_pin)
+            return &sim_parts[i];
+    if (n_sim_parts == MAX_SENSORS)
+        return NULL;
+
+    struct sim_part *p = &sim_parts[n_sim_parts++];
+    memset(p, 0, sizeof(*p));
+    p->pin = gpio_pin;
+    p->power_pin = power_pin;
+    p->ee_th = SIM_TH;
+    p->ee_tl = SIM_TL;
+    sim_state_load(p);
+
+    uint8_t rom[8] = { 0x22, (uint8_t)gpio_pin, 0x21, 0x18, 0x00, 0x00, 0x00, 0x00 };
+    rom[7] = ow_crc8(rom, 7);
+    memcpy(p->rom, rom, sizeof(rom));
+
+    sim_power_up(p, now_us() - SIM_POR_US - SIM_CONVERT_US);
+    sim_update(p);
+    return p;
+}
+
+static void sim_send(struct sim_part *p, const uint8_t *data, int n)
+{
+    memcpy(p->out, data, n);
+    p->nout = n;
+    p->outbit = 0;
+    p->state = SIM_READ;
+}
+
+static void sim_eeprom_write(struct sim_part *p)
+{
+    p->nvb_end_us = now_us() + SIM_EEPROM_US;
+    sim_state_save();
+}
+
+/* A complete byte from the master */
+static void sim_byte(struct sim_part *p, uint8_t b)
+{
+    uint8_t v;
+
+    switch (p->state) {
+    case SIM_ROM:
+        p->rombit = p->phase = 0;
+        p->state = b == OW_CMD_SKIP_ROM   ? SIM_CMD :
+                   b == OW_CMD_MATCH_ROM  ? SIM_MATCH :
+                   b == OW_CMD_SEARCH_ROM ? SIM_SEARCH : SIM_IDLE;
+        if (b == OW_CMD_READ_ROM)
+            sim_send(p, p->rom, 8);
+        break;
+
+    case SIM_CMD:
+        p->cmd = b;
+        p->state = SIM_IDLE;
+        switch (b) {
+        case DS1821_CMD_START_CONVERT:
+            p->flags &= ~DS1821_STATUS_DONE;
+            p->converting = 1;
+            p->continuous = !(p->ee_config & DS1821_STATUS_1SHOT);
+            p->conv_end_us = now_us() + SIM_CONVERT_US;
+            break;
+        case DS1821_CMD_STOP_CONVERT:
+            p->continuous = 0;      /* the current conversion still finishes */
+            break;
+        case DS1821_CMD_READ_TEMP:    sim_send(p, (uint8_t *)&p->temp, 1); break;
+        case DS1821_CMD_READ_COUNTER: sim_send(p, &p->count_remain, 1); break;
+        case DS1821_CMD_READ_SLOPE:
+            v = SIM_COUNT_PER_C;
+            sim_send(p, &v, 1);
+            break;
+        case DS1821_CMD_READ_TH:      sim_send(p, (uint8_t *)&p->ee_th, 1); break;
+        case DS1821_CMD_READ_TL:      sim_send(p, (uint8_t *)&p->ee_tl, 1); break;
+        case DS1821_CMD_READ_STATUS:
+            v = p->flags | p->ee_config | (p->nvb_end_us ? DS1821_STATUS_NVB : 0);
+            sim_send(p, &v, 1);
+            break;
+        case DS1821_CMD_WRITE_TH:
+        case DS1821_CMD_WRITE_TL:
+        case DS1821_CMD_WRITE_STATUS:
+            p->state = SIM_ARG;
+            break;
+        }
+        break;
+
+    case SIM_ARG:
+        if (p->cmd == DS1821_CMD_WRITE_TH) {
+            p->ee_th = (int8_t)b;
+        } else if (p->cmd == DS1821_CMD_WRITE_TL) {
+            p->ee_tl = (int8_t)b;
+        } else {
+            p->ee_config = b & DS1821_STATUS_CONFIG;
+            p->flags &= b | ~(DS1821_STATUS_THF | DS1821_STATUS_TLF);
+        }
+        sim_eeprom_write(p);
+        p->state = SIM_IDLE;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int sim_reset(void)
+{
+    struct sim_part *p = sim_part();
+    int presence = p && p->powered && now_us() - p->por_us >= SIM_POR_US;
+
+    if (presence) {
+        sim_update(p);
+        if (power_pin >= 0)
+            p->power_pin = power_pin;
+        p->state = p->onewire ? SIM_ROM : SIM_CMD;
+        p->shift = 0;
+        p->nbits = 0;
+    }
+    sim_skew_us += tm->reset_low + tm->reset_release + tm->reset_presence;
+
+    if (verbose)
+        printf("  [OW] Reset: presence %s\n", presence ? "DETECTED" : "not detected");
+    return presence;
+}
+
+static int sim_rom_bit(const struct sim_part *p)
+{
+    return (p->rom[p->rombit / 8] >> (p->rombit % 8)) & 1;
+}
+
+/* One slot's worth of data from the master */
+static void sim_take(struct sim_part *p, int bit)
+{
+    switch (p->state) {
+    case SIM_ROM:
+    case SIM_CMD:
+    case SIM_ARG:
+        p->shift |= (uint8_t)(bit << p->nbits);
+        if (++p->nbits == 8) {
+            uint8_t b = p->shift;
+            p->shift = 0;
+            p->nbits = 0;
+            sim_byte(p, b);
+        }
+        break;
+    case SIM_MATCH:
+    case SIM_SEARCH:
+        /* Search takes the direction bit after the two it sends */
+        if ((p->state == SIM_SEARCH && p->phase != 2) || bit != sim_rom_bit(p)) {
+            p->state = SIM_IDLE;
+            break;
+        }
+        p->phase = 0;
+        if (++p->rombit == 64)
+            p->state = SIM_CMD;
+        break;
+    case SIM_READ:
+        p->outbit++;    /* a write-1 slot is a read slot to the part */
+        break;
+    case SIM_IDLE:
+        break;
+    }
+}
+
+static void sim_write_bit(int bit)
+{
+    struct sim_part *p = sim_part();
+
+    sim_skew_us += bit ? tm->write1_low + tm->write1_release + tm->recovery
+                       : tm->write0_low + tm->write0_release + tm->recovery;
+    if (p && p->powered)
+        sim_take(p, bit);
+}
+
+static int sim_read_bit(void)
+{
+    struct sim_part *p = sim_part();
+    int bit = 1;
+
+    sim_skew_us += tm->read_low + tm->read_sample + tm->read_slot + tm->recovery;
+    if (!p || !p->powered)
+        return 1;
+
+    switch (p->state) {
+    case SIM_READ:
+        if (p->outbit < p->nout * 8) {
+            bit = (p->out[p->outbit / 8] >> (p->outbit % 8)) & 1;
+            p->outbit++;
+        }
+        if (sim_flip) {
+            sim_rand = sim_rand * 1103515245u + 12345u;
+            if ((sim_rand >> 16) % sim_flip == 0)
+                bit ^= 1;
+        }
+        break;
+    case SIM_SEARCH:
+        if (p->phase < 2)
+            bit = sim_rom_bit(p) ^ p->phase++;
+        break;
+    case SIM_ROM:
+    case SIM_CMD:
+    case SIM_ARG:
+        sim_take(p, 1);     /* the part sees a read slot as a 1 */
+        break;
+    default:
+        break;
+    }
+    return bit;
+}
+
+static void sim_write_byte(uint8_t byte)
+{
+    if (verbose)
+        printf("  [OW] Write: 0x%02X\n", byte);
+
+    for (int i = 0; i < 8; i++) {
+        sim_write_bit(byte & 0x01);
+        byte >>= 1;
+    }
+}
+
+static uint8_t sim_read_byte(void)
+{
+    uint8_t byte = 0;
+
+    for (int i = 0; i < 8; i++) {
+        if (sim_read_bit())
+            byte |= (1 << i);
+    }
+
+    if (verbose)
+        printf("  [OW] Read:  0x%02X\n", byte);
+
+    return byte;
+}
+
+static void sim_release(void)
+{
+}
+
+/* VDD on or off for every part last used with this power pin */
+static void sim_power(int pin, int on)
+{
+    for (int i = 0; i < n_sim_parts; i++) {
+        struct sim_part *p = &sim_parts[i];
+        if (p->power_pin != pin || p->powered == on)
+            continue;
+        if (on)
+            sim_power_up(p, now_us());
+        else
+            p->powered = 0;
+    }
+}
+
+/* DQ as --read-tout sees it: TOUT in thermostat mode, else pulled up */
+static int sim_tout(void)
+{
+    struct sim_part *p = sim_part();
+
+    if (!p || !p->powered || p->onewire)
+        return 1;
+    sim_update(p);
+    return (p->ee_config & DS1821_STATUS_POL) ? p->tout : !p->tout;
+}
+
+/* ── 1-Wire engine selection ─────────────────────────────────────── */
+
+/*
+ * write_bit/read_bit may be NULL if the transport has no single-slot
+ * access (Search ROM is then unavailable).  A transport that only does
+ * whole transactions sets txn instead of write_byte/read_byte; every
+ * DS1821 register access goes through ds1821_txn(), so retries,
+ * batching and caching apply to it unchanged.  simulated is set only
+ * for the sim engine, whose power and TOUT pins and clock are virtual.
+ */
+struct ow_engine {
+    const char *name;
+    int     needs_pigpio;
+    int     (*reset)(void);
+    void    (*write_bit)(int bit);
+    int     (*read_bit)(void);
+    void    (*write_byte)(uint8_t byte);
+    uint8_t (*read_byte)(void);
+    void    (*release)(void);
+    int     (*txn)(const uint8_t *wr, int nwr, uint8_t *rd, int nrd);
+    int     simulated;
+};
+
+static const struct ow_engine ow_engines[] = {
+    { "bitbang", 1, ow_reset,   ow_write_bit,   ow_read_bit,
+                    ow_write_byte,   ow_read_byte,   ow_release, NULL,   0 },
+    { "wave",    1, wave_reset, wave_write_bit, wave_read_bit,
+                    wave_write_byte, wave_read_byte, ow_release, NULL,   0 },
+    { "netlink", 0, nl_reset,   NULL,           NULL,
+                    nl_write_byte,   nl_read_byte,   nl_release, NULL,   0 },
+    { "sysfs",   0, rw_reset,   NULL,           NULL,
+                    NULL,            NULL,           nl_release, rw_txn, 0 },
+    { "sim",     0, sim_reset,  sim_write_bit,  sim_read_bit,
+                    sim_write_byte,  sim_read_byte,  sim_release, NULL,  1 },
+};
+
+static const struct ow_engine *ow = &ow_engines[0];
+
+static const struct ow_engine *find_engine(const char *name)
+{
+    for (size_t i = 0; i < sizeof(ow_engines) / sizeof(ow_engines[0]); i++)
+        if (strcmp(ow_engines[i].name, name) == 0)
+            return &ow_engines[i];
+    return NULL;
+}
+
+/* ── Metrics ─────────────────────────────────────────────────────── */
+
+/*
+ * Per-sensor counters and latency histograms.  The pointer follows
+ * select_sensor(), so every reset, conversion wait and EEPROM wait is
+ * charged to the sensor currently on the bus.  The daemon writes them for
+ * the node_exporter textfile collector with --metrics FILE.
+ */
+
+enum ow_stage { STAGE_RESET, STAGE_CONVERT, STAGE_EEPROM, STAGE_POWERUP, N_STAGES };
+
+#define N_BUCKETS 8
+
+/* Bucket upper bounds (µs), chosen around each stage's expected time */
+static const struct {
+    const char *name;
+    const char *help;
+    long le_us[N_BUCKETS];
+} stage_info[N_STAGES] = {
+    [STAGE_RESET]   = { "reset",   "a bus reset",
+                        { 1000, 1200, 1500, 2000, 5000, 10000, 50000, 100000 } },
+    [STAGE_CONVERT] = { "convert", "a conversion wait",
+                        { 100000, 200000, 300000, 400000, 500000, 750000, 1000000, 1500000 } },
+    [STAGE_EEPROM]  = { "eeprom",  "an EEPROM write wait",
+                        { 10000, 20000, 50000, 100000, 200000, 210000, 250000, 500000 } },
+    [STAGE_POWERUP] = { "powerup", "power-on reset, until the first presence pulse",
+                        { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 500000 } },
+};
+
+struct ow_metrics {
+    unsigned long bucket[N_STAGES][N_BUCKETS + 1];  /* last is +Inf */
+    unsigned long count[N_STAGES];
+    long long     sum_us[N_STAGES];
+    unsigned long no_presence;      /* reset with no presence pulse */
+    unsigned long crc_errors;       /* ROM code with a bad CRC */
+    unsigned long read_errors;      /* reading failed or was rejected */
+    unsigned long readings;         /* readings published */
+    unsigned long timing_fallbacks; /* timing profile dropped to standard */
+    unsigned long retries;          /* reads repeated after a mismatch */
+    unsigned long tout_changes;     /* TOUT edges seen by --watch-tout */
+    unsigned long unchanged;        /* readings that rewrote no files */
+};
+
+static struct ow_metrics cli_metrics;
+static struct ow_metrics *metrics = &cli_metrics;
+
+/* Monotonic, plus the virtual time of a simulated bus */
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + sim_skew_us;
+}
+
+/* Sleep through a bus wait; on the simulated bus, skip ahead instead */
+static void bus_wait_us(long us)
+{
+    if (ow->simulated)
+        sim_skew_us += us;
+    else
+        usleep(us);
+}
+
+/* Drive a VDD pin */
+static void bus_power(int pin, int on)
+{
+    if (ow->simulated) {
+        sim_power(pin, on);
+        return;
+    }
+    gpioSetMode(pin, PI_OUTPUT);
+    gpioWrite(pin, on);
+}
+
+static void metrics_observe(enum ow_stage st, long us)
+{
+    int b = 0;
+    while (b < N_BUCKETS && us > stage_info[st].le_us[b])
+        b++;
+    metrics->bucket[st][b]++;
+    metrics->count[st]++;
+    metrics->sum_us[st] += us;
+}
+
+/* Reset + presence through the current engine, timed and counted. */
+static int ow_bus_reset(void)
+{
+    long long start = now_us();
+    int presence = ow->reset();
+
+    metrics_observe(STAGE_RESET, now_us() - start);
+    if (!presence)
+        metrics->no_presence++;
+    return presence;
+}
+
+
+/* ── Real-time bus transactions ──────────────────────────────────── */
+
+/*
+ * A preemption in the middle of a bit-bang slot corrupts it silently.
+ * With --rt-cpu N the action runs on a dedicated bus thread pinned to
+ * core N.  That thread is raised to SCHED_FIFO only between the reset
+ * and the last bit of each transaction, and drops back to SCHED_OTHER
+ * for sleeps, file I/O and logging.  Memory is locked once when the
+ * thread starts: mlockall() on every transaction would fault the whole
+ * address space in and stall the slot it is meant to protect.
+ */
+
+static int rt_cpu = -1;         /* --rt-cpu N: enable, pin bus thread */
+static int rt_prio = 50;        /* --rt-prio N: SCHED_FIFO priority */
+static int rt_active = 0;       /* set on the bus thread once set up */
+
+static void ow_txn_begin(void)
+{
+    if (rt_active) {
+        struct sched_param sp = { .sched_priority = rt_prio };
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    }
+}
+
+static void ow_txn_end(void)
+{
+    if (rt_active) {
+        struct sched_param sp = { .sched_priority = 0 };
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+    }
+}
+
+/* Pin the calling thread, lock memory and allow RT transactions */
+static int rt_setup(void)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(rt_cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        fprintf(stderr, "Cannot pin bus thread to CPU %d: %s\n", rt_cpu, strerror(err));
+        return -1;
+    }
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        fprintf(stderr, "mlockall: %s (continuing unlocked)\n", strerror(errno));
+
+    /* Check SCHED_FIFO is allowed before relying on it */
+    struct sched_param sp = { .sched_priority = rt_prio };
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (err) {
+        fprintf(stderr, "Cannot use SCHED_FIFO priority %d: %s\n", rt_prio, strerror(err));
+        return -1;
+    }
+    sp.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+
+    rt_active = 1;
+    if (verbose)
+        printf("  [RT] bus thread on CPU %d, SCHED_FIFO %d per transaction\n",
+               rt_cpu, rt_prio);
+    return 0;
+}
+
+/* ── DS1821 high-level operations (thermostat mode — no ROM) ─────── */
+
+/*
+ * In thermostat mode there is no ROM layer.  After reset + presence,
+ * send the function command directly.
+ *
+ * Every access is one transaction: reset, nwr bytes written, nrd bytes
+ * read.  Returns 0, or -1 if there was no presence pulse.
+ */
+static int ds1821_txn(const uint8_t *wr, int nwr, uint8_t *rd, int nrd)
+{
+    if (ow->txn) {
+        long long start = now_us();
+        int ret = ow->txn(wr, nwr, rd, nrd);
+        metrics_observe(STAGE_RESET, now_us() - start);
+        if (ret < 0)
+            metrics->no_presence++;
+        return ret;
+    }
+
+    ow_txn_begin();
+    if (!ow_bus_reset()) {
+        ow_txn_end();
+        return -1;
+    }
+    for (int i = 0; i < nwr; i++)
+        ow->write_byte(wr[i]);
+    for (int i = 0; i < nrd; i++)
+        rd[i] = ow->read_byte();
+    ow_txn_end();
+    return 0;
+}
+
+/* Command + one byte read */
+static int ds1821_read_reg(uint8_t cmd, uint8_t *val)
+{
+    return ds1821_txn(&cmd, 1, val, 1);
+}
+
+/* ── Read verification and retry ─────────────────────────────────── */
+
+/*
+ * A glitched slot corrupts one byte silently, so register values are
+ * read until two consecutive reads agree, with a short bounded backoff
+ * after a mismatch or a missing presence pulse.  One bad slot costs a
+ * few hundred microseconds in-process rather than a whole new run.
+ * --retries 0 restores single-shot reads (not with a trimmed timing
+ * profile, where a disagreement is what triggers the fallback).
+ */
+
+#define RETRY_BACKOFF_FIRST_US  100
+#define RETRY_BACKOFF_MAX_US    2000
+
+static int read_retries = 2;    /* --retries N: extra reads allowed */
+
+static void retry_backoff(int attempt)
+{
+    long us = RETRY_BACKOFF_FIRST_US << (attempt < 5 ? attempt : 5);
+    bus_wait_us(us < RETRY_BACKOFF_MAX_US ? us : RETRY_BACKOFF_MAX_US);
+    metrics->retries++;
+}
+
+/* Drop back to the standard timing after a failed consistency check */
+static void timing_fallback(const char *why)
+{
+    fprintf(stderr, "GPIO%d: %s with %s timing — falling back to standard\n",
+            gpio_pin, why, tm->name);
+    tm = &ow_timings[0];
+    metrics->timing_fallbacks++;
+}
+
+/* Read a register until two reads in a row agree */
+static int ds1821_read_reg_verified(uint8_t cmd, uint8_t *val)
+{
+    if (read_retries == 0 && tm == &ow_timings[0])
+        return ds1821_read_reg(cmd, val);
+
+    uint8_t prev = 0;
+    int have = 0;
+
+    for (int i = 0; i < read_retries + 2; i++) {
+        uint8_t v;
+        if (ds1821_read_reg(cmd, &v) < 0) {
+            have = 0;
+            retry_backoff(i);
+            continue;
+        }
+        if (have && v == prev) {
+            *val = v;
+            return 0;
+        }
+        if (have) {
+            if (tm != &ow_timings[0])
+                timing_fallback("reads disagree");
+            retry_backoff(i);
+        }
+        prev = v;
+        have = 1;
+    }
+
+    if (verbose)
+        printf("  [OW] 0x%02X: no two reads agreed\n", cmd);
+    return -1;
+}
+
+static int ds1821_read_status_reg(uint8_t *status)
+{
+    if (ds1821_read_reg(DS1821_CMD_READ_STATUS, status) < 0) {
+        fprintf(stderr, "No presence pulse — check wiring!\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Let an EEPROM copy finish.  DQ is left high for the datasheet's 10 ms
+ * write time, then the status register is polled until NVB clears.  The
+ * old fixed 200 ms wait is now only the upper bound.  A poll can miss
+ * while the part is busy, so misses are not reported on their own.
+ * Returns 0, or -1 if NVB was still set (or never read) at the timeout,
+ * with a warning if report is set.
+ */
+#define EEPROM_WRITE_US     10000   /* tWR: DQ high, no bus traffic */
+#define EEPROM_POLL_US      2000    /* NVB poll interval after that */
+#define EEPROM_TIMEOUT_US   200000
+
+static int ds1821_eeprom_wait(int report)
+{
+    long long start = now_us();
+    int done = 0;
+
+    ow->release();
+    bus_wait_us(EEPROM_WRITE_US);
+    for (;;) {
+        uint8_t status;
+        if (ds1821_read_reg(DS1821_CMD_READ_STATUS, &status) == 0 &&
+            !(status & DS1821_STATUS_NVB)) {
+            done = 1;
+            break;
+        }
+        if (now_us() - start >= EEPROM_TIMEOUT_US)
+            break;
+        bus_wait_us(EEPROM_POLL_US);
+    }
+    metrics_observe(STAGE_EEPROM, now_us() - start);
+
+    if (!done && report)
+        fprintf(stderr, "EEPROM write not confirmed: NVB still set after %d ms\n",
+                EEPROM_TIMEOUT_US / 1000);
+    return done ? 0 : -1;
+}
+
+static int ds1821_write_status_reg(uint8_t status)
+{
+    uint8_t wr[] = { DS1821_CMD_WRITE_STATUS, status };
+    if (ds1821_txn(wr, 2, NULL, 0) < 0) {
+        fprintf(stderr, "No presence pulse — check wiring!\n");
+        return -1;
+    }
+
+    /*
+     * After writing the status register, the device copies it to
+     * EEPROM.  The NVB flag will be set during the write.
+     * Per datasheet, EEPROM write takes up to 10ms, but we'll be
+     * generous.  During this time DQ must remain high (pulled up).
+     * The fix sequence's read-back reports whether it took.
+     */
+    printf("  Waiting for EEPROM write...\n");
+    ds1821_eeprom_wait(0);
+    return 0;
+}
+
+/*
+ * Try writing status register using Skip ROM first (proper 1-Wire addressing).
+ * Some DS1821s in transitional state may need this.
+ */
+static int ds1821_write_status_skiprom(uint8_t status)
+{
+    /* Skip ROM — address all devices */
+    uint8_t wr[] = { OW_CMD_SKIP_ROM, DS1821_CMD_WRITE_STATUS, status };
+    if (ds1821_txn(wr, 3, NULL, 0) < 0) {
+        fprintf(stderr, "No presence pulse!\n");
+        return -1;
+    }
+
+    printf("  (Skip ROM) Waiting for EEPROM write...\n");
+    ds1821_eeprom_wait(0);
+    return 0;
+}
+
+static int ds1821_read_status_skiprom(uint8_t *status)
+{
+    uint8_t wr[] = { OW_CMD_SKIP_ROM, DS1821_CMD_READ_STATUS };
+    return ds1821_txn(wr, 2, status, 1);
+}
+
+static int ds1821_read_temperature(int8_t *temp)
+{
+    if (ds1821_read_reg_verified(DS1821_CMD_READ_TEMP, (uint8_t *)temp) < 0) {
+        fprintf(stderr, "Temperature read failed — no presence or reads disagree\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int ds1821_read_counter(uint8_t *count_remain)
+{
+    return ds1821_read_reg_verified(DS1821_CMD_READ_COUNTER, count_remain);
+}
+
+static int ds1821_read_slope(uint8_t *count_per_c)
+{
+    return ds1821_read_reg_verified(DS1821_CMD_READ_SLOPE, count_per_c);
+}
+
+/*
+ * Counter and slope as a pair.  count_remain can never exceed
+ * count_per_c, and a zero slope is impossible; either means a bad
+ * read, so the pair is read again.
+ */
+static int ds1821_read_counts(uint8_t *count_remain, uint8_t *count_per_c)
+{
+    for (int i = 0; ; i++) {
+        if (ds1821_read_counter(count_remain) < 0 ||
+            ds1821_read_slope(count_per_c) < 0)
+            return -1;
+        if (*count_per_c != 0 && *count_remain <= *count_per_c)
+            return 0;
+        if (tm != &ow_timings[0])
+            timing_fallback("impossible counter values");
+        if (i >= read_retries) {
+            fprintf(stderr, "GPIO%d: impossible count_remain=%u count_per_c=%u\n",
+                    gpio_pin, *count_remain, *count_per_c);
+            return -1;
+        }
+        retry_backoff(i);
+    }
+}
+
+static int ds1821_start_convert(void)
+{
+    uint8_t cmd = DS1821_CMD_START_CONVERT;
+
+    for (int i = 0; ds1821_txn(&cmd, 1, NULL, 0) < 0; i++) {
+        if (i >= read_retries)
+            return -1;
+        retry_backoff(i);
+    }
+    return 0;
+}
+
+/*
+ * Wait for a conversion started with ds1821_start_convert().
+ *
+ * By default this sleeps the full datasheet window.  With --poll-done
+ * the status register is polled with doubling backoff and we return as
+ * soon as DONE is set; a part that never sets DONE (continuous mode)
+ * costs no more than the fixed wait.
+ *
+ * Returns the measured wait in microseconds.
+ */
+static long ds1821_wait_convert(void)
+{
+    long long start = now_us();
+
+    if (!poll_done) {
+        bus_wait_us(CONVERT_TIMEOUT_US);
+    } else {
+        long interval = CONVERT_POLL_MIN_US;
+        bus_wait_us(CONVERT_POLL_FIRST_US);
+
+        for (;;) {
+            uint8_t status;
+            if (ds1821_read_status_reg(&status) == 0 && (status & DS1821_STATUS_DONE))
+                break;
+
+            long left = CONVERT_TIMEOUT_US - (now_us() - start);
+            if (left <= 0)
+                break;
+            bus_wait_us(interval < left ? interval : left);
+            if (interval < CONVERT_POLL_MAX_US)
+                interval *= 2;
+        }
+    }
+
+    long us = now_us() - start;
+    metrics_observe(STAGE_CONVERT, us);
+    return us;
+}
+
+static int ds1821_read_th(int8_t *th)
+{
+    return ds1821_read_reg_verified(DS1821_CMD_READ_TH, (uint8_t *)th);
+}
+
+static int ds1821_read_tl(int8_t *tl)
+{
+    return ds1821_read_reg_verified(DS1821_CMD_READ_TL, (uint8_t *)tl);
+}
+
+/* Write TH or TL.  The EEPROM copy is still running on return. */
+static int ds1821_write_thresh(uint8_t cmd, int8_t val)
+{
+    uint8_t wr[] = { cmd, (uint8_t)val };
+    if (ds1821_txn(wr, 2, NULL, 0) < 0) {
+        fprintf(stderr, "No presence pulse!\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int ds1821_write_th(int8_t th)
+{
+    if (ds1821_write_thresh(DS1821_CMD_WRITE_TH, th) < 0)
+        return -1;
+    if (!quiet)
+        printf("  Waiting for EEPROM write...\n");
+    return ds1821_eeprom_wait(1);
+}
+
+static int ds1821_write_tl(int8_t tl)
+{
+    if (ds1821_write_thresh(DS1821_CMD_WRITE_TL, tl) < 0)
+        return -1;
+    if (!quiet)
+        printf("  Waiting for EEPROM write...\n");
+    return ds1821_eeprom_wait(1);
+}
+
+/* ── Utility: print status register ──────────────────────────────── */
+
+static void print_status(uint8_t s)
+{
+    printf("  Status register: 0x%02X\n", s);
+    printf("    DONE  (bit 7): %d  — %s\n", !!(s & 0x80),
+           (s & 0x80) ? "conversion complete" : "conversion in progress");
+    printf("    THF   (bit 6): %d  — %s\n", !!(s & 0x40),
+           (s & 0x40) ? "HIGH alarm tripped" : "no high alarm");
+    printf("    TLF   (bit 5): %d  — %s\n", !!(s & 0x20),
+           (s & 0x20) ? "LOW alarm tripped" : "no low alarm");
+    printf("    NVB   (bit 4): %d  — %s\n", !!(s & 0x10),
+           (s & 0x10) ? "EEPROM write in progress" : "EEPROM idle");
+    printf("    POL   (bit 1): %d  — thermostat output polarity %s\n",
+           !!(s & 0x02), (s & 0x02) ? "active-high" : "active-low");
+    printf("    1SHOT (bit 0): %d  — %s mode\n", !!(s & 0x01),
+           (s & 0x01) ? "one-shot" : "continuous");
+}
+
+/*
+ * Read ROM — only works with a SINGLE 1-Wire device on the bus.
+ * Returns the 8-byte ROM code (family + 48-bit serial + CRC).
+ */
+static int ow_read_rom(uint8_t rom[8])
+{
+    uint8_t cmd = OW_CMD_READ_ROM;
+    if (ds1821_txn(&cmd, 1, rom, 8) < 0) {
+        printf("  No presence pulse.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * CRC8 for 1-Wire ROM codes (polynomial x^8+x^5+x^4+1 = 0x131).
+ */
+static uint8_t ow_crc8(const uint8_t *data, int len)
+{
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+        for (int j = 0; j < 8; j++) {
+            uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            byte >>= 1;
+        }
+    }
+    return crc;
+}
+
+static void print_rom(const uint8_t rom[8])
+{
+    printf("  ROM: ");
+    for (int i = 0; i < 8; i++)
+        printf("%02X", rom[i]);
+
+    uint8_t crc = ow_crc8(rom, 7);
+    printf("  (family=0x%02X, CRC %s)\n", rom[0],
+           crc == rom[7] ? "OK" : "BAD");
+
+    /* Identify known families */
+    switch (rom[0]) {
+    case 0x22: printf("         → Family 0x22 (DS1822 / DS1821 in 1-Wire mode)\n"); break;
+    case 0x10: printf("         → DS18S20 (thermometer)\n"); break;
+    case 0x28: printf("         → DS18B20 (thermometer)\n"); break;
+    case 0x3B: printf("         → DS1825 (thermometer)\n"); break;
+    case 0x42: printf("         → DS28EA00 (thermometer)\n"); break;
+    case 0x00: printf("         → Family 0 — likely thermostat-mode DS1821\n"); break;
+    default:   printf("         → Unknown family\n"); break;
+    }
+}
+
+/*
+ * 1-Wire Search ROM algorithm (per Maxim AN187).
+ * Finds all devices on the bus and stores their 64-bit ROM codes.
+ * Returns the number of devices found.
+ */
+static int ow_search_rom(uint8_t roms[][8], int max_devices)
+{
+    int device_count = 0;
+    int last_discrepancy = -1;
+    int done = 0;
+
+    uint8_t rom[8];
+    memset(rom, 0, sizeof(rom));
+
+    while (!done && device_count < max_devices) {
+        ow_txn_begin();
+        if (!ow_bus_reset()) {
+            ow_txn_end();
+            if (device_count == 0)
+                printf("  No presence pulse on search.\n");
+            break;
+        }
+
+        ow->write_byte(OW_CMD_SEARCH_ROM);
+
+        int new_discrepancy = -1;
+
+        for (int bit_pos = 0; bit_pos < 64; bit_pos++) {
+            int byte_idx = bit_pos / 8;
+            int bit_mask = 1 << (bit_pos % 8);
+
+            /* Read two bits: id_bit and cmp_bit */
+            int id_bit  = ow->read_bit();
+            int cmp_bit = ow->read_bit();
+
+            if (id_bit && cmp_bit) {
+                /* No devices responding — error or done */
+                done = 1;
+                break;
+            }
+
+            int dir;
+            if (id_bit != cmp_bit) {
+                /* All devices agree on this bit */
+                dir = id_bit;
+            } else {
+                /* Discrepancy — both 0 and 1 present */
+                if (bit_pos == last_discrepancy) {
+                    dir = 1;  /* Take the 1 branch this time */
+                } else if (bit_pos > last_discrepancy) {
+                    dir = 0;  /* Take the 0 branch first */
+                    new_discrepancy = bit_pos;
                 } else {
                     /* Use same direction as last search */
                     dir = (rom[byte_idx] & bit_mask) ? 1 : 0;
@@ -495,438 +1936,3716 @@ static int ow_search_rom(uint8_t roms[][8], int max_devices)
                 }
             }
 
-            /* Set the bit in our ROM buffer */
-            if (dir)
-                rom[byte_idx] |= bit_mask;
-            else
-                rom[byte_idx] &= ~bit_mask;
+            /* Set the bit in our ROM buffer */
+            if (dir)
+                rom[byte_idx] |= bit_mask;
+            else
+                rom[byte_idx] &= ~bit_mask;
+
+            /* Write direction bit to select that branch */
+            ow->write_bit(dir);
+        }
+        ow_txn_end();
+
+        if (!done) {
+            if (ow_crc8(rom, 7) != rom[7])
+                metrics->crc_errors++;
+            memcpy(roms[device_count], rom, 8);
+            device_count++;
+        }
+
+        last_discrepancy = new_discrepancy;
+        if (last_discrepancy < 0)
+            done = 1;  /* No more discrepancies — all devices found */
+    }
+
+    return device_count;
+}
+
+
+/* ── ROM cache ───────────────────────────────────────────────────── */
+
+/*
+ * A full Search ROM costs three slots for each of 64 bits per device.
+ * Devices found on a pin are cached in <cache_dir>/gpio<N>.roms (one
+ * hex ROM code per line, CRC-checked) and on the next scan each one is
+ * confirmed with a single verify pass.  Only if a cached device has
+ * gone missing do we fall back to a full search.  New devices are not
+ * noticed by the fast path — use --rescan after changing the wiring.
+ */
+
+static const char *cache_dir = DEFAULT_CACHE_DIR;
+static int force_rescan = 0;    /* --rescan: ignore the ROM cache */
+
+static int rom_valid(const uint8_t rom[8])
+{
+    return ow_crc8(rom, 7) == rom[7] && rom[0] != 0x00;
+}
+
+static void rom_cache_path(char *buf, size_t sz)
+{
+    snprintf(buf, sz, "%s/gpio%d.roms", cache_dir, gpio_pin);
+}
+
+static int rom_cache_load(uint8_t roms[][8], int max_devices)
+{
+    char path[512], line[64];
+    rom_cache_path(path, sizeof(path));
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+
+    int n = 0;
+    while (n < max_devices && fgets(line, sizeof(line), f)) {
+        unsigned int b[8];
+        if (sscanf(line, "%2x%2x%2x%2x%2x%2x%2x%2x",
+                   &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7]) != 8)
+            continue;
+        for (int i = 0; i < 8; i++)
+            roms[n][i] = (uint8_t)b[i];
+        if (rom_valid(roms[n]))
+            n++;
+    }
+
+    fclose(f);
+    return n;
+}
+
+static int rom_cache_save(uint8_t roms[][8], int count)
+{
+    char path[512], tmp[520];
+    rom_cache_path(path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    mkdir(cache_dir, 0755);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return -1;
+
+    for (int i = 0; i < count; i++) {
+        if (!rom_valid(roms[i]))
+            continue;
+        for (int j = 0; j < 8; j++)
+            fprintf(f, "%02X", roms[i][j]);
+        fprintf(f, "\n");
+    }
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Verify one ROM (AN187 "verify"): a search pass that always takes the
+ * branch matching `rom`.  Fails as soon as no device on the bus agrees
+ * with the next bit.  Returns 1 if the device is present.
+ */
+static int ow_verify_rom(const uint8_t rom[8])
+{
+    int found = 1;
+
+    ow_txn_begin();
+    if (!ow_bus_reset()) {
+        ow_txn_end();
+        return 0;
+    }
+
+    ow->write_byte(OW_CMD_SEARCH_ROM);
+
+    for (int bit_pos = 0; bit_pos < 64; bit_pos++) {
+        int want = (rom[bit_pos / 8] >> (bit_pos % 8)) & 1;
+        int id_bit  = ow->read_bit();
+        int cmp_bit = ow->read_bit();
+
+        if ((id_bit && cmp_bit) ||                  /* nobody left */
+            (id_bit != cmp_bit && id_bit != want)) { /* all disagree */
+            found = 0;
+            break;
+        }
+
+        ow->write_bit(want);
+    }
+    ow_txn_end();
+
+    return found;
+}
+
+/*
+ * Discover devices on the current pin, using the cache when every
+ * cached ROM still verifies.  *from_cache is set if no full search was
+ * needed.  Returns the number of ROMs in roms[].
+ */
+static int ow_discover(uint8_t roms[][8], int max_devices, int *from_cache)
+{
+    *from_cache = 0;
+
+    if (!force_rescan) {
+        int n = rom_cache_load(roms, max_devices);
+        int present = 0;
+        while (present < n && ow_verify_rom(roms[present]))
+            present++;
+        if (n > 0 && present == n) {
+            *from_cache = 1;
+            return n;
+        }
+        if (n > 0 && verbose)
+            printf("  ROM cache for GPIO%d is stale — full search\n", gpio_pin);
+    }
+
+    int count = ow_search_rom(roms, max_devices);
+
+    int valid = 0;
+    for (int i = 0; i < count; i++)
+        valid += rom_valid(roms[i]);
+    if (valid > 0 && rom_cache_save(roms, count) < 0 && verbose)
+        printf("  Could not write ROM cache in %s\n", cache_dir);
+
+    return count;
+}
+
+/* ── Actions ─────────────────────────────────────────────────────── */
+
+static int action_scan(void)
+{
+    printf("\n=== Scanning 1-Wire bus on GPIO%d ===\n\n", gpio_pin);
+
+    /* First: basic presence check */
+    printf("  1. Presence check...\n");
+    if (!ow_bus_reset()) {
+        printf("     No presence pulse — no devices responding at all.\n");
+        printf("     Check wiring: DQ→GPIO%d, 4.7kΩ pullup to 3.3V, GND.\n",
+               gpio_pin);
+        return -1;
+    }
+    printf("     Presence pulse detected — at least one device on bus.\n\n");
+
+    /* Try Read ROM (only valid with exactly 1 device) */
+    printf("  2. Read ROM (single-device command)...\n");
+    uint8_t rom[8];
+    if (ow_read_rom(rom) == 0) {
+        uint8_t crc = ow_crc8(rom, 7);
+        if (crc == rom[7] && rom[0] != 0x00) {
+            printf("     Single device found:\n     ");
+            print_rom(rom);
+        } else {
+            printf("     Got garbled ROM (multi-device collision or thermostat mode):\n     ");
+            print_rom(rom);
+            printf("     This is expected with multiple devices or thermostat-mode DS1821s.\n");
+        }
+    }
+    printf("\n");
+
+    /* Search ROM to find all 1-Wire mode devices */
+    printf("  3. Search ROM (multi-device enumeration)...\n");
+    uint8_t found_roms[16][8];
+    int count = 0, from_cache = 0;
+    if (ow->read_bit)
+        count = ow_discover(found_roms, 16, &from_cache);
+    else
+        printf("     Not available on the %s engine (no single-bit access).\n", ow->name);
+
+    if (from_cache)
+        printf("     Cached ROMs verified present (use --rescan for a full search).\n");
+
+    if (count == 0) {
+        printf("     No devices found via Search ROM.\n");
+        printf("     If DS1821s are in thermostat mode, they won't respond to ROM commands.\n");
+    } else {
+        printf("     Found %d device(s):\n", count);
+        int valid = 0, phantom = 0;
+        for (int i = 0; i < count; i++) {
+            printf("     [%d] ", i + 1);
+            print_rom(found_roms[i]);
+            uint8_t crc = ow_crc8(found_roms[i], 7);
+            if (crc == found_roms[i][7] && found_roms[i][0] != 0x00)
+                valid++;
+            else
+                phantom++;
+        }
+        if (phantom > 0) {
+            printf("\n     %d phantom device(s) detected — likely DS1821(s) in thermostat mode\n", phantom);
+            printf("     driving the bus and creating false ROM codes.\n");
+        }
+        if (valid > 0) {
+            printf("\n     %d valid 1-Wire device(s) found.\n", valid);
+        }
+    }
+
+    /* Probe thermostat-mode status (all respond simultaneously) */
+    printf("\n  4. Direct status read (thermostat-mode, no ROM)...\n");
+    printf("     Note: If multiple devices respond, bits are ANDed together.\n");
+    uint8_t status;
+    if (ds1821_read_status_reg(&status) == 0) {
+        print_status(status);
+        int8_t th, tl;
+        if (ds1821_read_th(&th) == 0 && ds1821_read_tl(&tl) == 0)
+            printf("\n  Alarm thresholds: TH=%d°C  TL=%d°C\n", th, tl);
+    }
+
+    printf("\n  Summary:\n");
+    printf("  ─────────\n");
+    printf("  Presence:      YES\n");
+    printf("  ROM devices:   %d\n", count);
+    printf("  You said:      3 devices connected\n");
+    printf("\n  Next steps:\n");
+    printf("    sudo ./ds1821_program fix     — attempt to reprogram all to 1-Wire mode\n");
+    printf("    sudo ./ds1821_program temp    — read temperature (all respond at once)\n");
+
+    return 0;
+}
+
+/*
+ * Read the TOUT state on the DQ/data pin.
+ * In thermostat mode, DQ doubles as the thermostat output.
+ * Returns 0 or 1 for the pin level, or -1 if not enabled.
+ */
+static int read_tout(void)
+{
+    if (!read_tout_flag)
+        return -1;
+    if (ow->simulated)
+        return sim_tout();
+    gpioSetMode(gpio_pin, PI_INPUT);
+    gpioSetPullUpDown(gpio_pin, PI_PUD_OFF);
+    return gpioRead(gpio_pin);
+}
+
+static int action_probe(void)
+{
+    if (!quiet)
+        printf("\n=== Probing DS1821 on GPIO%d ===\n\n", gpio_pin);
+
+    uint8_t status;
+    if (ds1821_read_status_reg(&status) < 0)
+        return -1;
+
+    int8_t th = 0, tl = 0;
+    int have_thresholds = (ds1821_read_th(&th) == 0 && ds1821_read_tl(&tl) == 0);
+    int tout = read_tout();
+
+    if (quiet) {
+        /* Machine-readable key=value output */
+        printf("status=0x%02X\n", status);
+        printf("done=%d\n",   (status & DS1821_STATUS_DONE) ? 1 : 0);
+        printf("thf=%d\n",    (status & DS1821_STATUS_THF)  ? 1 : 0);
+        printf("tlf=%d\n",    (status & DS1821_STATUS_TLF)  ? 1 : 0);
+        printf("nvb=%d\n",    (status & DS1821_STATUS_NVB)  ? 1 : 0);
+        printf("oneshot=%d\n",(status & DS1821_STATUS_1SHOT)? 1 : 0);
+        if (have_thresholds) {
+            printf("th=%d\n", th);
+            printf("tl=%d\n", tl);
+        }
+        if (tout >= 0)
+            printf("tout=%d\n", tout);
+    } else {
+        print_status(status);
+        if (have_thresholds)
+            printf("\n  Alarm thresholds: TH=%d°C  TL=%d°C\n", th, tl);
+        if (tout >= 0)
+            printf("  TOUT (DQ/GPIO%d): %s\n", gpio_pin,
+                   tout ? "HIGH (active)" : "LOW (inactive)");
+    }
+
+    return 0;
+}
+
+static int action_read_temp(void)
+{
+    if (!quiet)
+        printf("\n=== Reading Temperature from DS1821 ===\n\n");
+
+    /* Start conversion */
+    if (!quiet) printf("  Starting conversion...\n");
+    if (ds1821_start_convert() < 0)
+        return -1;
+
+    /* Wait for conversion — DS1821 needs up to 1s */
+    long conv_us = ds1821_wait_convert();
+
+    /* Check DONE */
+    uint8_t status;
+    if (ds1821_read_status_reg(&status) < 0)
+        return -1;
+    if (!(status & DS1821_STATUS_DONE) && !quiet) {
+        printf("  Warning: DONE bit not set, conversion may not be complete.\n");
+    }
+
+    /* Read temperature */
+    int8_t temp;
+    if (ds1821_read_temperature(&temp) < 0)
+        return -1;
+
+    /* Read counter and slope for high-res */
+    uint8_t count_remain, count_per_c;
+    if (ds1821_read_counts(&count_remain, &count_per_c) < 0)
+        return -1;
+
+    /* Calculate */
+    int cpc = count_per_c ? count_per_c : 1;
+    float hires = (float)temp - 0.25f +
+                  (float)(cpc - count_remain) / (float)cpc;
+    int millideg = (int)temp * 1000 - 250 +
+                   ((int)(cpc - count_remain) * 1000) / cpc;
+
+    int tout = read_tout();
+
+    if (quiet) {
+        /* Machine-readable: just the temperature */
+        printf("%.2f\n", hires);
+    } else {
+        printf("\n  ┌─────────────────────────────────────┐\n");
+        printf("  │  Integer temp:   %4d °C             │\n", temp);
+        printf("  │  COUNT_REMAIN:   %4d                │\n", count_remain);
+        printf("  │  COUNT_PER_C:    %4d                │\n", count_per_c);
+        printf("  │  Hi-res temp:    %7.2f °C          │\n", hires);
+        printf("  │  Millidegrees:   %5d m°C           │\n", millideg);
+        printf("  └─────────────────────────────────────┘\n");
+        printf("  Conversion time: %ld ms%s\n", conv_us / 1000,
+               poll_done ? "" : " (fixed wait)");
+
+        if (status & DS1821_STATUS_THF)
+            printf("  *** HIGH alarm flag set!\n");
+        if (status & DS1821_STATUS_TLF)
+            printf("  *** LOW alarm flag set!\n");
+        if (tout >= 0)
+            printf("  TOUT (DQ/GPIO%d): %s\n", gpio_pin,
+                   tout ? "HIGH (active)" : "LOW (inactive)");
+    }
+
+    return 0;
+}
+
+/* struct ds1821_reading is public, in ds1821.h */
+
+/*
+ * TH/TL and the POL/1SHOT configuration bits only change on an EEPROM
+ * write, so the daemon keeps them per sensor.  The cached copy is used
+ * until the status register shows NVB or different configuration bits,
+ * the daemon gets SIGHUP (e.g. after set-th from another process), the
+ * sensor is power-cycled, or --cache-refresh seconds have passed.
+ */
+struct ds1821_cache {
+    int     valid;
+    int8_t  th, tl;
+    uint8_t config;     /* status & DS1821_STATUS_CONFIG */
+    long long at_us;    /* when TH/TL were last read */
+};
+
+static int cache_refresh_s = 600;   /* --cache-refresh N, 0 = no caching */
+
+static int cache_usable(const struct ds1821_cache *c, uint8_t status)
+{
+    return c && c->valid && cache_refresh_s > 0 &&
+           !(status & DS1821_STATUS_NVB) &&
+           (status & DS1821_STATUS_CONFIG) == c->config &&
+           now_us() - c->at_us < cache_refresh_s * 1000000LL;
+}
+
+/*
+ * Collect the result of a conversion that has already been started
+ * and waited for.  Fills in *r; returns 0 on success, -1 on error.
+ * If status_known, r->status already holds the status register (read
+ * by the DONE poll).  cache may be NULL.
+ */
+static int ds1821_collect(struct ds1821_reading *r, struct ds1821_cache *cache,
+                          int status_known)
+{
+    if (!status_known && ds1821_read_status_reg(&r->status) < 0)
+        return -1;
+
+    if (ds1821_read_temperature(&r->temp) < 0)
+        return -1;
+
+    if (ds1821_read_counts(&r->count_remain, &r->count_per_c) < 0)
+        return -1;
+
+    int cpc = r->count_per_c ? r->count_per_c : 1;
+    r->millideg = (int)r->temp * 1000 - 250 +
+                  ((int)(cpc - r->count_remain) * 1000) / cpc;
+
+    if (cache_usable(cache, r->status)) {
+        r->th = cache->th;
+        r->tl = cache->tl;
+        r->have_th = 1;
+    } else {
+        r->th = r->tl = 0;
+        r->have_th = (ds1821_read_th(&r->th) == 0 && ds1821_read_tl(&r->tl) == 0);
+        if (cache) {
+            *cache = (struct ds1821_cache){
+                .valid  = r->have_th && !(r->status & DS1821_STATUS_NVB),
+                .th     = r->th,
+                .tl     = r->tl,
+                .config = r->status & DS1821_STATUS_CONFIG,
+                .at_us  = now_us(),
+            };
+        }
+    }
+    r->tout = read_tout();
+
+    return 0;
+}
+
+/*
+ * Check a non-standard timing profile before trusting it: status, TH
+ * and TL read once with the standard timing, then TIMING_SELFTEST_READS
+ * times with the selected one, must all agree.  DONE and NVB are masked
+ * as they may change between reads.  Falls back to standard otherwise.
+ */
+#define TIMING_SELFTEST_READS  8
+
+static void timing_self_test(void)
+{
+    const struct ow_timing *want = tm;
+    uint8_t st0, st;
+    int8_t th0, tl0, th, tl;
+
+    if (want == &ow_timings[0] || ow != &ow_engines[0])
+        return;
+
+    tm = &ow_timings[0];
+    if (ds1821_read_status_reg(&st0) < 0 || ds1821_read_th(&th0) < 0 ||
+        ds1821_read_tl(&tl0) < 0)
+        return;     /* no reference — stay on standard */
+
+    tm = want;
+    for (int i = 0; i < TIMING_SELFTEST_READS; i++) {
+        if (ds1821_read_status_reg(&st) < 0 || ds1821_read_th(&th) < 0 ||
+            ds1821_read_tl(&tl) < 0 ||
+            ((st ^ st0) & ~(DS1821_STATUS_DONE | DS1821_STATUS_NVB)) ||
+            th != th0 || tl != tl0) {
+            timing_fallback("self-test failed");
+            return;
+        }
+    }
+
+    if (verbose)
+        printf("  [OW] %s timing passed self-test on GPIO%d\n", tm->name, gpio_pin);
+}
+
+/* ── Publishing to /run/ds1821 ───────────────────────────────────── */
+
+static const char *run_dir = DEFAULT_RUN_DIR;
+static const char *publish_name = NULL;    /* --publish NAME */
+
+/*
+ * Write one value file atomically: readers see either the old or the
+ * new contents, never a truncated temperature.
+ */
+static int write_run_file(const char *dir, const char *file, const char *value)
+{
+    char path[512], tmp[520];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    snprintf(tmp, sizeof(tmp), "%s/.%s.tmp", dir, file);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "%s\n", value);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Append a reading to <dir>/ring.  *ring caches the mapping between
+ * calls (the daemon keeps one per sensor); with ring == NULL the file
+ * is mapped for this one push only.
+ */
+static int publish_ring(const char *dir, const struct ds1821_reading *r,
+                        struct ds1821_shm **ring)
+{
+    struct ds1821_shm *shm = ring ? *ring : NULL;
+
+    if (!shm) {
+        char path[520];
+        snprintf(path, sizeof(path), "%s/ring", dir);
+        shm = ds1821_shm_create(path);
+        if (!shm) {
+            fprintf(stderr, "Cannot map %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct ds1821_shm_sample s = {
+        .time_ns      = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+        .millideg     = r->millideg,
+        .temp         = r->temp,
+        .count_remain = r->count_remain,
+        .count_per_c  = r->count_per_c,
+        .status       = r->status,
+    };
+    ds1821_shm_push(shm, &s);
+
+    if (ring)
+        *ring = shm;
+    else
+        ds1821_shm_unmap(shm);
+    return 0;
+}
+
+/* publish_reading() files */
+#define PUB_TEMP    0x01
+#define PUB_ALARMS  0x02
+#define PUB_THRESH  0x04
+#define PUB_TOUT    0x08
+#define PUB_ALL     0x0f
+
+/*
+ * Write a reading to <run_dir>/<name>/, mirroring the w1_therm sysfs
+ * layout: temperature, alarms, thresholds, tout, plus the shared-memory
+ * ring (see ds1821_shm.h).  Only the files in the PUB_* mask are
+ * rewritten; the ring gets every reading.
+ */
+static int publish_reading(const char *name, const struct ds1821_reading *r,
+                           struct ds1821_shm **ring, unsigned files)
+{
+    char dir[512], buf[64];
+
+    mkdir(run_dir, 0755);
+    if (snprintf(dir, sizeof(dir), "%s/%s", run_dir, name) >= (int)sizeof(dir))
+        return -1;
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    int ret = 0;
+    if (files & PUB_TEMP) {
+        snprintf(buf, sizeof(buf), "%d", r->millideg);
+        ret |= write_run_file(dir, "temperature", buf);
+    }
+    if (files & PUB_ALARMS) {
+        snprintf(buf, sizeof(buf), "thf=%d tlf=%d",
+                 (r->status & DS1821_STATUS_THF) ? 1 : 0,
+                 (r->status & DS1821_STATUS_TLF) ? 1 : 0);
+        ret |= write_run_file(dir, "alarms", buf);
+    }
+    if (r->have_th && (files & PUB_THRESH)) {
+        snprintf(buf, sizeof(buf), "th=%d tl=%d", r->th, r->tl);
+        ret |= write_run_file(dir, "thresholds", buf);
+    }
+    if (r->tout >= 0 && (files & PUB_TOUT)) {
+        snprintf(buf, sizeof(buf), "%d", r->tout);
+        ret |= write_run_file(dir, "tout", buf);
+    }
+    ret |= publish_ring(dir, r, ring);
+
+    return ret;
+}
+
+/*
+ * status action — machine-readable dump of everything:
+ * temperature + thresholds + alarm flags + TOUT.
+ * Always outputs key=value format regardless of --quiet.
+ */
+static int action_status(void)
+{
+    /* Start conversion */
+    if (ds1821_start_convert() < 0)
+        return -1;
+    long conv_us = ds1821_wait_convert();
+
+    struct ds1821_reading r;
+    if (ds1821_collect(&r, NULL, 0) < 0)
+        return -1;
+    r.conv_us = conv_us;
+
+    printf("temperature=%d\n", r.millideg);
+    printf("thf=%d\n", (r.status & DS1821_STATUS_THF) ? 1 : 0);
+    printf("tlf=%d\n", (r.status & DS1821_STATUS_TLF) ? 1 : 0);
+    if (r.have_th) {
+        printf("th=%d\n", r.th);
+        printf("tl=%d\n", r.tl);
+    }
+    if (r.tout >= 0)
+        printf("tout=%d\n", r.tout);
+    if (poll_done)
+        printf("conv_ms=%ld\n", r.conv_us / 1000);
+
+    if (publish_name)
+        return publish_reading(publish_name, &r, NULL, PUB_ALL);
+
+    return 0;
+}
+
+static int action_set_thresholds(int set_th, int set_tl, int8_t new_th, int8_t new_tl)
+{
+    printf("\n=== DS1821 Thermostat Thresholds ===\n\n");
+
+    /* Read current values */
+    int8_t cur_th, cur_tl;
+    if (ds1821_read_th(&cur_th) < 0 || ds1821_read_tl(&cur_tl) < 0)
+        return -1;
+
+    printf("  Current: TH=%d°C  TL=%d°C\n", cur_th, cur_tl);
+
+    if (set_th) {
+        printf("  Writing TH=%d°C...\n", new_th);
+        if (ds1821_write_th(new_th) < 0)
+            return -1;
+    }
+    if (set_tl) {
+        printf("  Writing TL=%d°C...\n", new_tl);
+        if (ds1821_write_tl(new_tl) < 0)
+            return -1;
+    }
+
+    /* Verify */
+    if (ds1821_read_th(&cur_th) < 0 || ds1821_read_tl(&cur_tl) < 0)
+        return -1;
+
+    printf("  Verified: TH=%d°C  TL=%d°C\n", cur_th, cur_tl);
+
+    if (cur_tl >= cur_th)
+        printf("  Warning: TL >= TH — thermostat will not operate correctly.\n");
+
+    return 0;
+}
+
+static int action_set_oneshot(void)
+{
+    printf("\n=== Setting DS1821(s) to 1-Wire / One-Shot mode ===\n\n");
+
+    /* Read current status */
+    uint8_t status;
+    if (ds1821_read_status_reg(&status) < 0)
+        return -1;
+
+    printf("  Current status (direct, ANDed if multiple devices):\n");
+    print_status(status);
+
+    /*
+     * Write status: 1SHOT=1, POL=0, clear alarm flags.
+     * We try MULTIPLE methods since these devices may be in different states:
+     *   1. Direct write (thermostat mode — no ROM command)
+     *   2. Skip ROM + write (proper 1-Wire addressing)
+     *   3. Repeat both for good measure
+     */
+    uint8_t new_status = DS1821_STATUS_1SHOT;  /* 0x01 */
+
+    printf("\n  === Attempt 1: Direct write (no ROM) ===\n");
+    printf("  Writing status: 0x%02X\n", new_status);
+    if (ds1821_write_status_reg(new_status) < 0)
+        return -1;
+
+    /* Verify */
+    if (ds1821_read_status_reg(&status) == 0) {
+        printf("  Read back: 0x%02X  1SHOT=%d POL=%d\n",
+               status, !!(status & DS1821_STATUS_1SHOT), !!(status & 0x02));
+    }
+
+    printf("\n  === Attempt 2: Skip ROM + write ===\n");
+    printf("  Writing status: 0x%02X\n", new_status);
+    if (ds1821_write_status_skiprom(new_status) < 0)
+        return -1;
+
+    /* Verify via skip ROM too */
+    if (ds1821_read_status_skiprom(&status) == 0) {
+        printf("  Read back (skip ROM): 0x%02X  1SHOT=%d POL=%d\n",
+               status, !!(status & DS1821_STATUS_1SHOT), !!(status & 0x02));
+    }
+
+    printf("\n  === Attempt 3: Direct write again ===\n");
+    if (ds1821_write_status_reg(new_status) < 0)
+        return -1;
+
+    /* Final verification */
+    printf("\n  Final readback:\n");
+    if (ds1821_read_status_reg(&status) == 0) {
+        print_status(status);
+    }
+    if (ds1821_read_status_skiprom(&status) == 0) {
+        printf("  Via Skip ROM: 0x%02X\n", status);
+    }
+
+    printf("\n  Note: With 3 devices on the bus, status reads are ANDed.\n");
+    printf("  If ANY device has 1SHOT=0, the combined read shows 0.\n");
+    printf("  The write goes to ALL devices simultaneously, so all should\n");
+    printf("  be programmed. A power cycle may be needed for the change\n");
+    printf("  to take effect.\n");
+
+    return 0;
+}
+
+
+/*
+ * Power-cycle DS1821s via a GPIO pin driving their VDD.  After VDD comes
+ * up, send a reset every POR_POLL_US and stop at the first presence
+ * pulse; POR_TIMEOUT_US is only the upper bound.  Polling resets don't
+ * count towards no_presence.
+ */
+#define POR_POLL_US     1000
+#define POR_TIMEOUT_US  500000
+
+static int power_off_ms = 500;  /* --off-ms N: VDD off time in a power cycle */
+
+/* Wait for the DS1821 on the current pin.  Returns 0, or -1 on timeout. */
+static int ds1821_power_up_wait(void)
+{
+    long long start = now_us();
+    int present;
+
+    do {
+        bus_wait_us(POR_POLL_US);
+        present = ow->reset();
+    } while (!present && now_us() - start < POR_TIMEOUT_US);
+
+    metrics_observe(STAGE_POWERUP, now_us() - start);
+    if (verbose)
+        printf("  [OW] Power-up: %s after %ld µs\n",
+               present ? "presence" : "no presence", (long)(now_us() - start));
+    return present ? 0 : -1;
+}
+
+static int power_cycle_ds1821(void)
+{
+    if (power_pin < 0) {
+        if (!quiet)
+            printf("\nNo --power-gpio set — cannot power-cycle.\n"
+                   "  Please disconnect and reconnect DS1821 VDD manually.\n");
+        return -1;
+    }
+
+    if (!quiet)
+        printf("\nPower-cycling DS1821s via GPIO%d...\n", power_pin);
+
+    /* Drive power pin LOW to cut VDD */
+    bus_power(power_pin, 0);
+
+    if (!quiet)
+        printf("  VDD OFF — waiting %d ms for capacitors to drain...\n", power_off_ms);
+    bus_wait_us(power_off_ms * 1000L);
+
+    /* Drive power pin HIGH to restore VDD */
+    bus_power(power_pin, 1);
+
+    if (!quiet)
+        printf("  VDD ON — waiting for a presence pulse...\n");
+    ow->release();
+    if (ds1821_power_up_wait() < 0 && !quiet)
+        printf("  No presence pulse after %d ms.\n", POR_TIMEOUT_US / 1000);
+
+    if (!quiet)
+        printf("  Power cycle complete.\n");
+
+    return 0;
+}
+
+/*
+ * Ensure the power pin stays HIGH after pigpio terminates.
+ * pigpio resets all pins on gpioTerminate(), so we use pinctrl
+ * to re-assert the output state.
+ */
+static void persist_power_pin(void)
+{
+    if (power_pin < 0)
+        return;
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd),
+             "pinctrl set %d op dh 2>/dev/null", power_pin);
+    if (system(cmd) != 0) {
+        /* Fallback: try raspi-gpio */
+        snprintf(cmd, sizeof(cmd),
+                 "raspi-gpio set %d op dh 2>/dev/null", power_pin);
+        system(cmd);
+    }
+}
+
+/* ── Bus locks ───────────────────────────────────────────────────── */
+
+/*
+ * Every process that drives a bus first takes an flock() on
+ * /run/lock/ds1821/<bus>, whatever its --run-dir.  The bus names are:
+ *
+ *   - "gpioN" for each data, power and TX pin it drives
+ *   - "w1_bus_masterN" or the slave ID, for the kernel engines
+ *   - "pigpio" whenever it starts pigpio, which allows one user per
+ *     machine anyway
+ *
+ * A second invocation then waits its turn, up to --lock-wait seconds,
+ * instead of failing gpioInitialise() or bit-banging a pin that is
+ * already in use.  Locks are taken in name order, so two processes that
+ * want overlapping sets can't deadlock, and the kernel drops them when
+ * a process exits.
+ */
+
+#define MAX_LOCKS     (3 * MAX_SENSORS + 1)
+#define LOCK_POLL_US  50000
+
+static int  lock_wait_s = 30;   /* --lock-wait N */
+static char lock_names[MAX_LOCKS][40];
+static int  lock_fds[MAX_LOCKS];
+static int  n_locks, n_locked;
+
+static void bus_lock_add(const char *name)
+{
+    for (int i = 0; i < n_locks; i++)
+        if (strcmp(lock_names[i], name) == 0)
+            return;
+    if (n_locks < MAX_LOCKS)
+        snprintf(lock_names[n_locks++], sizeof(lock_names[0]), "%s", name);
+}
+
+/* Add the locks for one sensor's bus with the current engine */
+static void bus_lock_add_bus(int data, int power, int tx, int master, const char *dev)
+{
+    char name[40];
+
+    if (ow->simulated)
+        return;     /* every simulated bus is private to its process */
+    if (ow->needs_pigpio)
+        snprintf(name, sizeof(name), "gpio%d", data);
+    else if (ow->txn)
+        snprintf(name, sizeof(name), "%.39s", dev ? dev : "w1_device");
+    else
+        snprintf(name, sizeof(name), "w1_bus_master%d", master);
+    bus_lock_add(name);
+
+    if (power >= 0) {
+        snprintf(name, sizeof(name), "gpio%d", power);
+        bus_lock_add(name);
+    }
+    if (tx >= 0 && ow->needs_pigpio) {
+        snprintf(name, sizeof(name), "gpio%d", tx);
+        bus_lock_add(name);
+    }
+    if (use_pigpio)
+        bus_lock_add("pigpio");
+}
+
+static int cmp_lock_name(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+/* Take every lock added so far.  Returns 0, or -1 after --lock-wait. */
+static int bus_lock(void)
+{
+    char path[128];
+
+    mkdir(LOCK_DIR, 0755);
+
+    qsort(lock_names, n_locks, sizeof(lock_names[0]), cmp_lock_name);
+    for (; n_locked < n_locks; n_locked++) {
+        const char *name = lock_names[n_locked];
+        snprintf(path, sizeof(path), "%s/%s", LOCK_DIR, name);
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+
+        long long waited = 0;
+        while (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+            if (errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "Cannot lock %s: %s\n", path, strerror(errno));
+                close(fd);
+                return -1;
+            }
+            if (waited == 0 && !quiet)
+                fprintf(stderr, "Waiting for %s (in use by another ds1821)...\n", name);
+            if (waited >= lock_wait_s * 1000000LL) {
+                fprintf(stderr, "%s still in use after %d s (is ds1821d running without its socket?)\n",
+                        name, lock_wait_s);
+                close(fd);
+                return -1;
+            }
+            usleep(LOCK_POLL_US);
+            waited += LOCK_POLL_US;
+        }
+        lock_fds[n_locked] = fd;
+    }
+    return 0;
+}
+
+static void bus_unlock(void)
+{
+    while (n_locked > 0)
+        close(lock_fds[--n_locked]);
+    n_locks = 0;
+}
+
+/* ── Profile action ──────────────────────────────────────────────── */
+
+/*
+ * Measure what the bit-bang engine really puts on the wire.  Bursts of
+ * reset, write-1, write-0 and read slots run while pigpio's DMA sampler
+ * timestamps every DQ edge (into the wave engine's alert buffer).  Each
+ * measured width is then checked against its datasheet window.  main()
+ * raises the sample rate to 1 µs for this action.  gpioDelay() overshoot
+ * and scheduling stalls show up as the gap between the value asked for
+ * and the measured p50/p99.
+ */
+
+#define PROFILE_BURST   64      /* slots per capture (2 edges each) */
+#define PROFILE_RESETS  10      /* slots per reset, for the reset count */
+
+static int profile_slots = 2000;    /* --slots N */
+
+enum {
+    P_RESET_LOW, P_PRESENCE_WAIT, P_PRESENCE_LOW,
+    P_WRITE1_LOW, P_WRITE1_SLOT, P_WRITE0_LOW, P_WRITE0_SLOT,
+    P_READ_LOW, P_READ_SAMPLE, P_READ_SLOT, N_PROF
+};
+
+struct prof_series {
+    const char *name;
+    int min_us, max_us;     /* datasheet window */
+    const char *knob;       /* timing value that moves it, NULL = none */
+    size_t knob_off;        /* its offset in struct ow_timing */
+    long *v;
+    int n;
+};
+
+#define KNOB(field)  #field, offsetof(struct ow_timing, field)
+
+static struct prof_series prof[N_PROF] = {
+    [P_RESET_LOW]     = { "reset_low",     480, 960, KNOB(reset_low),      NULL, 0 },
+    [P_PRESENCE_WAIT] = { "presence_wait",  15,  60, NULL, 0,              NULL, 0 },
+    [P_PRESENCE_LOW]  = { "presence_low",   60, 240, NULL, 0,              NULL, 0 },
+    [P_WRITE1_LOW]    = { "write1_low",      1,  15, KNOB(write1_low),     NULL, 0 },
+    [P_WRITE1_SLOT]   = { "write1_slot",    61, 121, KNOB(write1_release), NULL, 0 },
+    [P_WRITE0_LOW]    = { "write0_low",     60, 120, KNOB(write0_low),     NULL, 0 },
+    [P_WRITE0_SLOT]   = { "write0_slot",    61, 121, KNOB(write0_release), NULL, 0 },
+    [P_READ_LOW]      = { "read_low",        1,  15, KNOB(read_low),       NULL, 0 },
+    [P_READ_SAMPLE]   = { "read_sample",     3,  15, KNOB(read_sample),    NULL, 0 },
+    [P_READ_SLOT]     = { "read_slot",      61, 121, KNOB(read_slot),      NULL, 0 },
+};
+
+static void prof_add(int series, long us)
+{
+    if (prof[series].n < profile_slots)
+        prof[series].v[prof[series].n++] = us;
+}
+
+static void profile_capture_start(void)
+{
+    wave_n_edges = 0;
+    gpioSetAlertFunc(gpio_pin, wave_alert);
+}
+
+static int profile_capture_stop(int expect_edges)
+{
+    for (int waited = 0; waited < WAVE_FLUSH_US &&
+                         wave_n_edges < expect_edges; waited += 500)
+        usleep(500);
+    gpioSetAlertFunc(gpio_pin, NULL);
+    return wave_n_edges;
+}
+
+/*
+ * Record low widths and fall-to-fall periods of a captured burst.
+ * falls[] receives the tick of each falling edge.
+ */
+static int profile_slots_from_edges(int low_series, int slot_series,
+                                    uint32_t *falls, int max_falls)
+{
+    int n = wave_n_edges, nf = 0;
+
+    for (int i = 0; i < n && nf < max_falls; i++) {
+        if (wave_edge_level[i] != 0)
+            continue;
+        if (nf > 0 && slot_series >= 0)
+            prof_add(slot_series, (long)(wave_edge_tick[i] - falls[nf - 1]));
+        falls[nf++] = wave_edge_tick[i];
+        if (i + 1 < n && wave_edge_level[i + 1] == 1)
+            prof_add(low_series, (long)(wave_edge_tick[i + 1] - wave_edge_tick[i]));
+    }
+    return nf;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static void prof_free(void)
+{
+    for (int i = 0; i < N_PROF; i++) {
+        free(prof[i].v);
+        prof[i].v = NULL;
+    }
+}
+
+static int action_profile(void)
+{
+    int n_resets = profile_slots / PROFILE_RESETS;
+    uint32_t falls[PROFILE_BURST], sample_tick[PROFILE_BURST];
+
+    for (int i = 0; i < N_PROF; i++) {
+        prof[i].v = calloc(profile_slots, sizeof(long));
+        if (!prof[i].v) {
+            fprintf(stderr, "Out of memory\n");
+            prof_free();
+            return -1;
+        }
+    }
+
+    if (!quiet)
+        printf("\nProfiling %d slots of each type on GPIO%d (%s timing)...\n",
+               profile_slots, gpio_pin, tm->name);
+
+    /* Resets: master low, master release, presence low, presence end */
+    for (int i = 0; i < n_resets; i++) {
+        profile_capture_start();
+        ow_reset();
+        if (profile_capture_stop(4) >= 4 && wave_edge_level[0] == 0) {
+            prof_add(P_RESET_LOW,     (long)(wave_edge_tick[1] - wave_edge_tick[0]));
+            prof_add(P_PRESENCE_WAIT, (long)(wave_edge_tick[2] - wave_edge_tick[1]));
+            prof_add(P_PRESENCE_LOW,  (long)(wave_edge_tick[3] - wave_edge_tick[2]));
+        }
+    }
+
+    /*
+     * Slot bursts start right after a reset.  The DS1821 takes the first
+     * eight slots as a command byte: 0xFF and 0x00 are not commands, and
+     * read slots look like 1 bits, so it never drives DQ during a burst.
+     */
+    for (int done = 0; done < profile_slots; done += PROFILE_BURST) {
+        ow_reset();
+        profile_capture_start();
+        for (int k = 0; k < PROFILE_BURST; k++)
+            ow_write_bit(1);
+        profile_capture_stop(2 * PROFILE_BURST);
+        profile_slots_from_edges(P_WRITE1_LOW, P_WRITE1_SLOT, falls, PROFILE_BURST);
+
+        ow_reset();
+        profile_capture_start();
+        for (int k = 0; k < PROFILE_BURST; k++)
+            ow_write_bit(0);
+        profile_capture_stop(2 * PROFILE_BURST);
+        profile_slots_from_edges(P_WRITE0_LOW, P_WRITE0_SLOT, falls, PROFILE_BURST);
+
+        /* Same sequence as ow_read_bit(), plus a tick at the sample */
+        ow_reset();
+        profile_capture_start();
+        for (int k = 0; k < PROFILE_BURST; k++) {
+            ow_drive_low();
+            gpioDelay(tm->read_low);
+            ow_release();
+            gpioDelay(tm->read_sample);
+            (void)ow_read_bit_raw();
+            sample_tick[k] = gpioTick();
+            gpioDelay(tm->read_slot);
+            gpioDelay(tm->recovery);
+        }
+        profile_capture_stop(2 * PROFILE_BURST);
+        int nf = profile_slots_from_edges(P_READ_LOW, P_READ_SLOT, falls, PROFILE_BURST);
+        for (int k = 0; k < nf; k++)
+            prof_add(P_READ_SAMPLE, (long)(sample_tick[k] - falls[k]));
+    }
+
+    if (prof[P_WRITE1_LOW].n == 0) {
+        fprintf(stderr, "No DQ edges captured — is GPIO%d the 1-Wire bus?\n", gpio_pin);
+        prof_free();
+        return -1;
+    }
+
+    printf("\n  %-14s %6s %6s %6s %6s %6s  %-9s %5s\n",
+           "stage (µs)", "n", "min", "p50", "p99", "max", "window", "out");
+
+    int out_total = 0;
+    for (int i = 0; i < N_PROF; i++) {
+        struct prof_series *ps = &prof[i];
+        char window[16];
+        snprintf(window, sizeof(window), "%d-%d", ps->min_us, ps->max_us);
+        if (ps->n == 0) {
+            printf("  %-14s %6d %6s %6s %6s %6s  %-9s %5s\n",
+                   ps->name, 0, "-", "-", "-", "-", window, "-");
+            continue;
+        }
+
+        qsort(ps->v, ps->n, sizeof(long), cmp_long);
+        int out = 0;
+        for (int k = 0; k < ps->n; k++)
+            if (ps->v[k] < ps->min_us || ps->v[k] > ps->max_us)
+                out++;
+        out_total += out;
+
+        printf("  %-14s %6d %6ld %6ld %6ld %6ld  %-9s %5d\n", ps->name, ps->n,
+               ps->v[0], ps->v[ps->n / 2], ps->v[(ps->n * 99) / 100],
+               ps->v[ps->n - 1], window, out);
+    }
+
+    /*
+     * Suggest the shortest setting for each knob that keeps p1 and p99
+     * a margin inside the window.  Measured widths include the fixed
+     * gpioSetMode()/gpioDelay() overhead, so the shift moves both ends.
+     */
+    printf("\nSuggested timing for this host (µs):\n");
+    for (int i = 0; i < N_PROF; i++) {
+        struct prof_series *ps = &prof[i];
+        if (!ps->knob || ps->n == 0)
+            continue;
+
+        int margin = ps->min_us / 10 > 2 ? ps->min_us / 10 : 2;
+        long lo = ps->v[ps->n / 100], hi = ps->v[(ps->n * 99) / 100];
+        long shift = (ps->min_us + margin) - lo;
+        if (hi + shift > ps->max_us - margin)
+            shift = (ps->max_us - margin) - hi;
+
+        int now = *(const int *)((const char *)tm + ps->knob_off);
+        long want = now + shift;
+        if (want < 1)
+            want = 1;
+        printf("  %-15s %4ld   (now %d)%s\n", ps->knob, want, now,
+               hi - lo > ps->max_us - ps->min_us - 2 * margin ?
+               "  — jitter wider than the window" : "");
+    }
+
+    if (!quiet)
+        printf("\n%d of the measured widths fell outside the datasheet window.\n",
+               out_total);
+
+    prof_free();
+    return 0;
+}
+
+/* ── Benchmark action ────────────────────────────────────────────── */
+
+/*
+ * Run --reads complete readings back to back on the selected engine and
+ * report per-stage latency as a single JSON object on stdout:
+ *
+ *   reset      one reset + presence (mean within each reading)
+ *   command    the Start Convert transaction
+ *   convert    the conversion wait (fixed sleep, or DONE with --poll-done)
+ *   registers  status, temperature, counter, slope and TH/TL reads
+ *   publish    writing <run_dir>/bench/ and its ring
+ *   total      one whole reading
+ *
+ * The TH/TL cache is used as the daemon would, so reading 1 pays for
+ * TH/TL and the rest don't.  "make bench" runs this on each engine, and
+ * "make bench-sim" on the simulated bus, without hardware.
+ */
+
+enum { B_RESET, B_COMMAND, B_CONVERT, B_REGISTERS, B_PUBLISH, B_TOTAL, N_BENCH };
+
+static const char *const bench_stage[N_BENCH] = {
+    "reset", "command", "convert", "registers", "publish", "total",
+};
+
+static int bench_reads = 100;   /* --reads N */
+
+static void bench_print_stage(const char *name, long *v, int n, int last)
+{
+    long sum = 0;
+
+    qsort(v, n, sizeof(long), cmp_long);
+    for (int i = 0; i < n; i++)
+        sum += v[i];
+    printf("    \"%s\": {\"n\": %d, \"mean_us\": %ld, \"p50_us\": %ld, "
+           "\"p99_us\": %ld, \"max_us\": %ld}%s\n", name, n,
+           n ? sum / n : 0, n ? v[n / 2] : 0, n ? v[(n * 99) / 100] : 0,
+           n ? v[n - 1] : 0, last ? "" : ",");
+}
+
+static int action_bench(void)
+{
+    long *v[N_BENCH];
+    int n[N_BENCH] = { 0 };
+    int ok = 0;
+    struct ds1821_cache cache = { 0 };
+    struct ds1821_shm *ring = NULL;
+
+    for (int i = 0; i < N_BENCH; i++) {
+        v[i] = calloc(bench_reads, sizeof(long));
+        if (!v[i]) {
+            while (i--)
+                free(v[i]);
+            return -1;
+        }
+    }
+
+    long long start = now_us(), wall_start = start - sim_skew_us;
+    for (int k = 0; k < bench_reads && keep_running; k++) {
+        struct ds1821_reading r;
+        unsigned long resets = metrics->count[STAGE_RESET];
+        long long reset_us = metrics->sum_us[STAGE_RESET];
+        long long t0 = now_us();
+
+        ow->release();
+        if (ds1821_start_convert() < 0)
+            continue;
+        long long t1 = now_us();
+        r.conv_us = ds1821_wait_convert();
+        long long t2 = now_us();
+        if (ds1821_collect(&r, &cache, 0) < 0)
+            continue;
+        long long t3 = now_us();
+        if (publish_reading("bench", &r, &ring, PUB_ALL) < 0)
+            continue;
+        long long t4 = now_us();
+
+        v[B_COMMAND][n[B_COMMAND]++] = t1 - t0;
+        v[B_CONVERT][n[B_CONVERT]++] = t2 - t1;
+        v[B_REGISTERS][n[B_REGISTERS]++] = t3 - t2;
+        v[B_PUBLISH][n[B_PUBLISH]++] = t4 - t3;
+        v[B_TOTAL][n[B_TOTAL]++] = t4 - t0;
+        if (metrics->count[STAGE_RESET] > resets)
+            v[B_RESET][n[B_RESET]++] = (metrics->sum_us[STAGE_RESET] - reset_us) /
+                                       (metrics->count[STAGE_RESET] - resets);
+        ok++;
+    }
+    long long elapsed = now_us() - start;
+    long long wall = now_us() - sim_skew_us - wall_start;
+    ds1821_shm_unmap(ring);
+
+    printf("{\n");
+    printf("  \"engine\": \"%s\",\n", ow->name);
+    printf("  \"timing\": \"%s\",\n", tm->name);
+    printf("  \"gpio\": %d,\n", gpio_pin);
+    printf("  \"poll_done\": %s,\n", poll_done ? "true" : "false");
+    printf("  \"reads\": %d,\n", bench_reads);
+    printf("  \"ok\": %d,\n", ok);
+    printf("  \"retries\": %lu,\n", metrics->retries);
+    printf("  \"elapsed_us\": %lld,\n", elapsed);
+    printf("  \"reads_per_s\": %.3f,\n", elapsed > 0 ? ok * 1e6 / elapsed : 0.0);
+    if (ow->simulated) {   /* reads_per_s is in virtual time: what hardware would do */
+        printf("  \"wall_us\": %lld,\n", wall);
+        printf("  \"wall_reads_per_s\": %.3f,\n", wall > 0 ? ok * 1e6 / wall : 0.0);
+    }
+    printf("  \"stages\": {\n");
+    for (int i = 0; i < N_BENCH; i++)
+        bench_print_stage(bench_stage[i], v[i], n[i], i == N_BENCH - 1);
+    printf("  }\n}\n");
+
+    for (int i = 0; i < N_BENCH; i++)
+        free(v[i]);
+
+    return ok == bench_reads ? 0 : -1;
+}
+
+/* ── Network push (--push) ───────────────────────────────────────── */
+
+/*
+ * With --push URL the daemon sends each cycle's readings as one JSON
+ * message: a UDP datagram (udp://host:port) or an MQTT 3.1.1 publish at
+ * QoS 1 (mqtt://host[:port][/topic], default topic ds1821/<hostname>).
+ *
+ * The daemon only formats the message and queues it.  All socket I/O
+ * happens on a sender thread, so a slow or missing broker never delays
+ * the bus.  While the peer can't be reached, messages stay queued (the
+ * oldest is dropped past PUSH_QUEUE) and the sender reconnects with a
+ * doubling backoff.  Once it is back, the queue drains in order, with up
+ * to PUSH_WINDOW publishes in flight before the first PUBACK is read.
+ * A message leaves the queue only once MQTT has acknowledged it, so a
+ * lost connection means resending, never losing.
+ */
+
+#define PUSH_QUEUE          1024    /* about 17 h of cycles at 60 s */
+#define PUSH_WINDOW         16      /* messages per send burst */
+#define PUSH_TIMEOUT_S      5       /* connect, send and PUBACK timeout */
+#define PUSH_BACKOFF_MAX_S  60
+#define MQTT_PORT           "1883"
+
+static const char *push_url = NULL;     /* --push URL */
+static int  push_mqtt;
+static char push_host[256], push_port[8], push_topic[256];
+static char push_hostname[64];
+static int  push_fd = -1;
+static uint16_t push_packet_id;
+
+static pthread_mutex_t push_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  push_cond = PTHREAD_COND_INITIALIZER;
+static char *push_q[PUSH_QUEUE];
+static unsigned long push_head, push_tail;  /* push_q[push_tail] is the oldest */
+static int  push_busy;                      /* messages at the tail being sent */
+static int  push_stop;
+static unsigned long push_sent, push_dropped;
+static pthread_t push_thread;
+static int  push_running;
+
+/* Split --push URL.  Returns 0 or -1. */
+static int push_parse_url(const char *url)
+{
+    const char *rest;
+
+    if (strncmp(url, "udp://", 6) == 0) {
+        push_mqtt = 0;
+        rest = url + 6;
+    } else if (strncmp(url, "mqtt://", 7) == 0) {
+        push_mqtt = 1;
+        rest = url + 7;
+    } else {
+        fprintf(stderr, "--push: expected udp://host:port or mqtt://host[:port][/topic]\n");
+        return -1;
+    }
+
+    gethostname(push_hostname, sizeof(push_hostname) - 1);
+
+    const char *slash = strchr(rest, '/');
+    size_t hlen = slash ? (size_t)(slash - rest) : strlen(rest);
+    if (hlen == 0 || hlen >= sizeof(push_host)) {
+        fprintf(stderr, "--push: bad host in %s\n", url);
+        return -1;
+    }
+    memcpy(push_host, rest, hlen);
+    push_host[hlen] = '\0';
+
+    char *colon = strrchr(push_host, ':');
+    if (colon) {
+        *colon = '\0';
+        snprintf(push_port, sizeof(push_port), "%s", colon + 1);
+    } else if (push_mqtt) {
+        snprintf(push_port, sizeof(push_port), "%s", MQTT_PORT);
+    } else {
+        fprintf(stderr, "--push: udp:// needs a port\n");
+        return -1;
+    }
+
+    if (slash && slash[1])
+        snprintf(push_topic, sizeof(push_topic), "%s", slash + 1);
+    else
+        snprintf(push_topic, sizeof(push_topic), "ds1821/%s", push_hostname);
+    return 0;
+}
+
+static int push_write_all(const uint8_t *p, size_t len)
+{
+    while (len) {
+        ssize_t n = send(push_fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int push_read_all(uint8_t *p, size_t len)
+{
+    while (len) {
+        ssize_t n = recv(push_fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* MQTT fixed header: type/flags byte and variable-length remaining length */
+static int mqtt_header(uint8_t *buf, uint8_t type, size_t len)
+{
+    int n = 0;
+    buf[n++] = type;
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        buf[n++] = b | (len ? 0x80 : 0);
+    } while (len);
+    return n;
+}
+
+/* Read one MQTT packet into body.  Returns its type byte, or -1. */
+static int mqtt_read_packet(uint8_t *body, size_t max, size_t *len)
+{
+    uint8_t type, b;
+    size_t n = 0;
+    int shift = 0;
+
+    if (push_read_all(&type, 1) < 0)
+        return -1;
+    do {
+        if (push_read_all(&b, 1) < 0 || shift > 21)
+            return -1;
+        n |= (size_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    if (n > max || push_read_all(body, n) < 0)
+        return -1;
+    *len = n;
+    return type;
+}
+
+static int mqtt_connect(void)
+{
+    char client[24];        /* 23 characters is all 3.1.1 brokers must take */
+    snprintf(client, sizeof(client), "ds1821-%.16s", push_hostname);
+    size_t clen = strlen(client);
+
+    uint8_t pkt[64], var[64];
+    size_t v = 0;
+    memcpy(var, "\0\4MQTT", 6);
+    v = 6;
+    var[v++] = 4;           /* protocol level 3.1.1 */
+    var[v++] = 0x02;        /* clean session */
+    var[v++] = 0;           /* keepalive off: PUBACK timeouts catch a dead link */
+    var[v++] = 0;
+    var[v++] = clen >> 8;
+    var[v++] = clen & 0xff;
+    memcpy(var + v, client, clen);
+    v += clen;
+
+    int h = mqtt_header(pkt, 0x10, v);
+    memcpy(pkt + h, var, v);
+    if (push_write_all(pkt, h + v) < 0)
+        return -1;
+
+    uint8_t body[8];
+    size_t len;
+    if (mqtt_read_packet(body, sizeof(body), &len) != 0x20 || len != 2 || body[1] != 0) {
+        fprintf(stderr, "push: %s:%s refused the MQTT connection\n", push_host, push_port);
+        return -1;
+    }
+    return 0;
+}
+
+static void push_disconnect(void)
+{
+    if (push_fd >= 0)
+        close(push_fd);
+    push_fd = -1;
+}
+
+static int push_connect(void)
+{
+    struct addrinfo hints = { .ai_socktype = push_mqtt ? SOCK_STREAM : SOCK_DGRAM };
+    struct addrinfo *ai, *a;
+    int rc = getaddrinfo(push_host, push_port, &hints, &ai);
+    if (rc != 0) {
+        if (verbose)
+            fprintf(stderr, "push: %s: %s\n", push_host, gai_strerror(rc));
+        return -1;
+    }
+
+    struct timeval tv = { .tv_sec = PUSH_TIMEOUT_S };
+    for (a = ai; a; a = a->ai_next) {
+        push_fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (push_fd < 0)
+            continue;
+        setsockopt(push_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(push_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(push_fd, a->ai_addr, a->ai_addrlen) == 0)
+            break;
+        push_disconnect();
+    }
+    freeaddrinfo(ai);
+
+    if (push_fd < 0 || (push_mqtt && mqtt_connect() < 0)) {
+        push_disconnect();
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Send msgs in order.  UDP: one datagram each.  MQTT: every publish goes
+ * out first, then the PUBACKs are collected.  Returns how many messages
+ * at the front of msgs got through.
+ */
+static int push_send(char *const *msgs, int n)
+{
+    uint16_t ids[PUSH_WINDOW];
+
+    for (int i = 0; i < n; i++) {
+        size_t mlen = strlen(msgs[i]);
+        if (!push_mqtt) {
+            if (send(push_fd, msgs[i], mlen, MSG_NOSIGNAL) < 0)
+                return i;
+            continue;
+        }
+
+        size_t tlen = strlen(push_topic);
+        uint8_t hdr[8 + 2 + sizeof(push_topic) + 2];
+        int h = mqtt_header(hdr, 0x32, 2 + tlen + 2 + mlen);   /* PUBLISH, QoS 1 */
+        if (++push_packet_id == 0)
+            push_packet_id = 1;
+        ids[i] = push_packet_id;
+        hdr[h++] = tlen >> 8;
+        hdr[h++] = tlen & 0xff;
+        memcpy(hdr + h, push_topic, tlen);
+        h += tlen;
+        hdr[h++] = ids[i] >> 8;
+        hdr[h++] = ids[i] & 0xff;
+        if (push_write_all(hdr, h) < 0 || push_write_all((const uint8_t *)msgs[i], mlen) < 0)
+            return 0;
+    }
+    if (!push_mqtt)
+        return n;
+
+    int acked = 0;
+    while (acked < n) {
+        uint8_t body[8];
+        size_t len;
+        int type = mqtt_read_packet(body, sizeof(body), &len);
+        if (type < 0)
+            break;
+        if (type == 0x40 && len == 2 && ((body[0] << 8) | body[1]) == ids[acked])
+            acked++;
+    }
+    return acked;
+}
+
+/* Wait up to s seconds, or until push_stop.  Called with push_lock held. */
+static void push_sleep_locked(int s)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += s;
+    while (!push_stop &&
+           pthread_cond_timedwait(&push_cond, &push_lock, &until) != ETIMEDOUT)
+        ;
+}
+
+static void *push_main(void *arg)
+{
+    (void)arg;
+    int backoff = 1;
+
+    pthread_mutex_lock(&push_lock);
+    for (;;) {
+        while (!push_stop && push_head == push_tail)
+            pthread_cond_wait(&push_cond, &push_lock);
+        if (push_head == push_tail)
+            break;      /* stopping with nothing left */
+
+        char *batch[PUSH_WINDOW];
+        int n = 0;
+        while (n < PUSH_WINDOW && push_tail + n < push_head) {
+            batch[n] = push_q[(push_tail + n) % PUSH_QUEUE];
+            n++;
+        }
+        push_busy = n;
+        pthread_mutex_unlock(&push_lock);
+
+        int sent = (push_fd >= 0 || push_connect() == 0) ? push_send(batch, n) : -1;
+        if (sent < n)
+            push_disconnect();
+
+        pthread_mutex_lock(&push_lock);
+        for (int i = 0; i < sent; i++)
+            free(push_q[(push_tail + i) % PUSH_QUEUE]);
+        if (sent > 0) {
+            push_tail += sent;
+            push_sent += sent;
+        }
+        push_busy = 0;
+
+        if (sent < n) {
+            if (push_stop)
+                break;  /* one last try on the way out */
+            push_sleep_locked(backoff);
+            backoff = backoff * 2 > PUSH_BACKOFF_MAX_S ? PUSH_BACKOFF_MAX_S : backoff * 2;
+        } else {
+            backoff = 1;
+        }
+    }
+    pthread_mutex_unlock(&push_lock);
+    push_disconnect();
+    return NULL;
+}
+
+/*
+ * Queue a message (malloc'ed; the queue owns it).  Never blocks on the
+ * network: with the queue full, the oldest message not being sent is
+ * dropped, or this one if the sender holds them all.
+ */
+static void push_enqueue(char *msg)
+{
+    pthread_mutex_lock(&push_lock);
+    if (push_head - push_tail >= PUSH_QUEUE) {
+        push_dropped++;
+        if (push_busy) {
+            pthread_mutex_unlock(&push_lock);
+            free(msg);
+            return;
+        }
+        free(push_q[push_tail % PUSH_QUEUE]);
+        push_tail++;
+    }
+    push_q[push_head % PUSH_QUEUE] = msg;
+    push_head++;
+    pthread_cond_signal(&push_cond);
+    pthread_mutex_unlock(&push_lock);
+}
+
+/* Signals are left to the bus thread, so SIGTERM still ends its sleep */
+static int push_start(void)
+{
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&push_thread, NULL, push_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        fprintf(stderr, "Cannot start push thread\n");
+        return -1;
+    }
+    push_running = 1;
+    return 0;
+}
+
+/* Stop the sender after one last attempt to flush the queue */
+static void push_finish(void)
+{
+    if (!push_running)
+        return;
+    pthread_mutex_lock(&push_lock);
+    push_stop = 1;
+    pthread_cond_broadcast(&push_cond);
+    pthread_mutex_unlock(&push_lock);
+    pthread_join(push_thread, NULL);
+    push_running = 0;
+
+    if (push_head != push_tail)
+        fprintf(stderr, "push: %lu message(s) not sent to %s\n",
+                push_head - push_tail, push_url);
+    while (push_tail != push_head)
+        free(push_q[push_tail++ % PUSH_QUEUE]);
+}
+
+/* ── Daemon (ds1821d) ────────────────────────────────────────────── */
+
+/*
+ * One line of sensors.conf:
+ *   <name> <data-gpio> [power-gpio] [read-tout] [key=value ...]
+ */
+struct sensor {
+    char name[64];
+    int  data_pin;
+    int  power_pin;     /* -1 = not used */
+    int  read_tout;
+    int  tx_pin;        /* tx=N: wave engine open-drain driver, -1 = none */
+    int  w1_master;     /* w1=N: netlink engine w1_bus_masterN */
+    char w1_device[32]; /* w1dev=ID: sysfs engine slave, "" = --w1-device */
+    struct ds1821_shm *ring;    /* mapped <run_dir>/<name>/ring */
+    struct hist_log *hist;      /* mapped <history_dir>/<name>.hist */
+    struct ow_metrics *metrics;
+    const struct ow_timing *timing;     /* timing=NAME, bit-bang only */
+    int  retries;       /* retries=N: extra reads per register */
+    struct ds1821_cache cache;  /* TH/TL and config bits */
+    int  gated;         /* shares its data pin: powered only for its turn */
+    int  group_pos;     /* turn within its data pin's round-robin */
+    int  self_tested;   /* timing self-test done */
+    volatile int tout_level;    /* --watch-tout: last TOUT level, -1 = unknown */
+    int  want_th, want_tl;      /* th=/tl=: provision targets, NO_TARGET = none */
+    int  off_ms;        /* off=N: VDD off time before power-up (ms) */
+    long long off_at_us;  /* when VDD was last switched off, 0 = never */
+    int  delta;         /* delta=N: publish after N m°C of change, -1 = always */
+    int  heartbeat;     /* heartbeat=N: republish after N s unchanged, 0 = never */
+    struct ds1821_reading pub;  /* values in the published files */
+    long long pub_at_us;  /* when temperature was last written, 0 = never */
+    int  every_min, every_max;  /* interval=MIN[:MAX] (s), 0 = --interval */
+    int  every;         /* current interval, adapted between the bounds */
+    long long due_ns;   /* CLOCK_MONOTONIC time of the next reading */
+    int  idle;          /* not due in this cycle */
+    double rate;        /* recent |dT/dt| (m°C/s) */
+    int  last_md;       /* previous reading, for the rate */
+    long long last_ns;  /* ... and when it was taken, 0 = none yet */
+};
+
+#define NO_TARGET  (-128)   /* outside the -55..125 °C threshold range */
+
+static struct sensor sensors[MAX_SENSORS];
+static struct ow_metrics sensor_metrics[MAX_SENSORS];
+static const char *metrics_path = NULL;    /* --metrics FILE */
+static int n_sensors = 0;
+
+/*
+ * Per-sensor key=value options that may follow the positional fields.
+ * Returns 0 if the option was recognised, -1 if not.
+ */
+static int parse_sensor_option(struct sensor *s, const char *key, const char *val)
+{
+    if (strcmp(key, "tx") == 0) {
+        s->tx_pin = atoi(val);
+        return 0;
+    }
+    if (strcmp(key, "w1") == 0) {
+        s->w1_master = atoi(val);
+        return 0;
+    }
+    if (strcmp(key, "w1dev") == 0) {
+        snprintf(s->w1_device, sizeof(s->w1_device), "%s", val);
+        return 0;
+    }
+    if (strcmp(key, "retries") == 0) {
+        s->retries = atoi(val);
+        return s->retries >= 0 ? 0 : -1;
+    }
+    if (strcmp(key, "timing") == 0) {
+        s->timing = find_timing(val);
+        return s->timing ? 0 : -1;
+    }
+    if (strcmp(key, "off") == 0) {
+        s->off_ms = atoi(val);
+        return s->off_ms >= 0 ? 0 : -1;
+    }
+    if (strcmp(key, "delta") == 0) {
+        s->delta = atoi(val);
+        return s->delta >= 0 ? 0 : -1;
+    }
+    if (strcmp(key, "heartbeat") == 0) {
+        s->heartbeat = atoi(val);
+        return s->heartbeat >= 0 ? 0 : -1;
+    }
+    if (strcmp(key, "interval") == 0) {
+        const char *colon = strchr(val, ':');
+        s->every_min = atoi(val);
+        s->every_max = colon ? atoi(colon + 1) : s->every_min;
+        return (s->every_min >= 1 && s->every_max >= s->every_min) ? 0 : -1;
+    }
+    if (strcmp(key, "th") == 0 || strcmp(key, "tl") == 0) {
+        int v = atoi(val);
+        if (v < -55 || v > 125)
+            return -1;
+        *(key[1] == 'h' ? &s->want_th : &s->want_tl) = v;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Parse the sensor config file (same format ds1821-update reads).
+ * Returns the number of sensors loaded, or -1 if the file can't be opened.
+ */
+static int load_config(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[256];
+    int lineno = 0;
+    n_sensors = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+
+        /* Strip comments */
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        /* Positional fields first, key=value options anywhere after */
+        char *field[4] = { NULL };
+        int nfield = 0;
+        struct sensor tmp = { .power_pin = -1, .tx_pin = -1, .w1_master = w1_master,
+                              .timing = tm, .retries = read_retries,
+                              .want_th = NO_TARGET, .want_tl = NO_TARGET,
+                              .off_ms = power_off_ms, .delta = -1 };
+        int bad = 0;
+
+        if (w1_device)
+            snprintf(tmp.w1_device, sizeof(tmp.w1_device), "%s", w1_device);
+        for (char *tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+            char *eq = strchr(tok, '=');
+            if (eq) {
+                *eq = '\0';
+                if (parse_sensor_option(&tmp, tok, eq + 1) < 0) {
+                    fprintf(stderr, "%s:%d: unknown option '%s'\n", path, lineno, tok);
+                    bad = 1;
+                }
+            } else if (nfield < 4) {
+                field[nfield++] = tok;
+            }
+        }
+
+        if (nfield == 0)
+            continue;   /* blank line */
+        if (nfield < 2 || bad) {
+            fprintf(stderr, "%s:%d: skipping malformed line\n", path, lineno);
+            continue;
+        }
+        if (n_sensors >= MAX_SENSORS) {
+            fprintf(stderr, "%s: more than %d sensors, ignoring the rest\n",
+                    path, MAX_SENSORS);
+            break;
+        }
+
+        snprintf(tmp.name, sizeof(tmp.name), "%s", field[0]);
+        tmp.data_pin = atoi(field[1]);
+        if (field[2] && strcmp(field[2], "-") != 0)
+            tmp.power_pin = atoi(field[2]);
+        if (field[3])
+            tmp.read_tout = (strcmp(field[3], "yes") == 0 || strcmp(field[3], "1") == 0 ||
+                             strcmp(field[3], "true") == 0);
+
+        tmp.metrics = &sensor_metrics[n_sensors];
+        sensors[n_sensors++] = tmp;
+    }
+
+    fclose(f);
+    return n_sensors;
+}
+
+/*
+ * Point the bit-bang layer at a sensor's pins.
+ */
+static void select_sensor(const struct sensor *s)
+{
+    gpio_pin = s->data_pin;
+    power_pin = s->power_pin;
+    read_tout_flag = s->read_tout;
+    tx_pin = s->tx_pin;
+    w1_master = s->w1_master;
+    w1_device = s->w1_device[0] ? s->w1_device : NULL;
+    metrics = s->metrics ? s->metrics : &cli_metrics;
+    tm = s->timing ? s->timing : &ow_timings[0];
+    read_retries = s->retries;
+    power_off_ms = s->off_ms;
+}
+
+
+/*
+ * Shared conversion wait for a batch.  With --poll-done every pending
+ * bus is polled in turn and the wait ends once all have set DONE, so
+ * the batch costs the slowest sensor rather than the datasheet max.
+ * done_us[i] receives the time each sensor took, and done_status[i]
+ * the status byte that showed DONE (-1 if none was read).
+ */
+static void wait_convert_batch(struct sensor *const *list, int n,
+                               const int *pending_in, long *done_us,
+                               int *done_status)
+{
+    long long start = now_us();
+    int pending[MAX_SENSORS], left = 0;
+
+    for (int i = 0; i < n; i++) {
+        pending[i] = pending_in[i];
+        left += pending[i];
+        done_status[i] = -1;
+    }
+    if (!left)
+        return;
+
+    if (!poll_done) {
+        bus_wait_us(CONVERT_TIMEOUT_US);
+        for (int i = 0; i < n; i++) {
+            done_us[i] = now_us() - start;
+            if (pending[i]) {
+                select_sensor(list[i]);
+                metrics_observe(STAGE_CONVERT, done_us[i]);
+            }
+        }
+        return;
+    }
+
+    long interval = CONVERT_POLL_MIN_US;
+    bus_wait_us(CONVERT_POLL_FIRST_US);
+
+    while (left > 0) {
+        for (int i = 0; i < n; i++) {
+            uint8_t status;
+            if (!pending[i])
+                continue;
+            select_sensor(list[i]);
+            if (ds1821_read_status_reg(&status) == 0 &&
+                (status & DS1821_STATUS_DONE)) {
+                pending[i] = 0;
+                done_us[i] = now_us() - start;
+                done_status[i] = status;
+                left--;
+            }
+        }
+
+        long remain = CONVERT_TIMEOUT_US - (now_us() - start);
+        if (left == 0 || remain <= 0)
+            break;
+        bus_wait_us(interval < remain ? interval : remain);
+        if (interval < CONVERT_POLL_MAX_US)
+            interval *= 2;
+    }
+
+    for (int i = 0; i < n; i++)
+        if (pending[i])
+            done_us[i] = now_us() - start;
+
+    for (int i = 0; i < n; i++) {
+        if (pending_in[i]) {
+            select_sensor(list[i]);
+            metrics_observe(STAGE_CONVERT, done_us[i]);
+        }
+    }
+}
+
+/*
+ * Read a set of sensors with one shared conversion window: Start
+ * Convert goes out on every bus first, then a single wait covers all
+ * of them, then each result is collected.  Cycle time stays about 1 s
+ * (less with --poll-done) however many pins are configured.  ok[i] is
+ * set for each sensor read successfully; returns the number that failed.
+ */
+static int read_batch(struct sensor *const *list, int n,
+                      struct ds1821_reading *out, int *ok)
+{
+    int started = 0, errors = 0;
+
+    for (int i = 0; i < n; i++) {
+        select_sensor(list[i]);
+        ow->release();
+        ok[i] = (ds1821_start_convert() == 0);
+        started += ok[i];
+    }
+
+    long done_us[MAX_SENSORS];
+    int done_status[MAX_SENSORS];
+    if (started)
+        wait_convert_batch(list, n, ok, done_us, done_status);
+
+    for (int i = 0; i < n; i++) {
+        if (ok[i]) {
+            select_sensor(list[i]);
+            /* The status read that saw DONE already has THF/TLF */
+            int known = done_status[i] >= 0;
+            if (known)
+                out[i].status = (uint8_t)done_status[i];
+            ok[i] = (ds1821_collect(&out[i], &list[i]->cache, known) == 0);
+            out[i].conv_us = done_us[i];
+            list[i]->timing = tm;    /* keep a fallback to standard */
+        }
+        if (!ok[i]) {
+            fprintf(stderr, "ds1821d: failed to read DS1821 '%s'\n", list[i]->name);
+            select_sensor(list[i]);
+            metrics->read_errors++;
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+/*
+ * Write every sensor's metrics in the Prometheus text format, via a temp
+ * file and rename() so the textfile collector never scrapes half a file.
+ */
+static int write_metrics(const char *path)
+{
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+
+    for (int st = 0; st < N_STAGES; st++) {
+        fprintf(f, "# HELP ds1821_%s_seconds Time spent in %s.\n",
+                stage_info[st].name, stage_info[st].help);
+        fprintf(f, "# TYPE ds1821_%s_seconds histogram\n", stage_info[st].name);
+        for (int i = 0; i < n_sensors; i++) {
+            const struct ow_metrics *m = sensors[i].metrics;
+            unsigned long cum = 0;
+            for (int b = 0; b < N_BUCKETS; b++) {
+                cum += m->bucket[st][b];
+                fprintf(f, "ds1821_%s_seconds_bucket{sensor=\"%s\",gpio=\"%d\",le=\"%g\"} %lu\n",
+                        stage_info[st].name, sensors[i].name, sensors[i].data_pin,
+                        stage_info[st].le_us[b] / 1e6, cum);
+            }
+            cum += m->bucket[st][N_BUCKETS];
+            fprintf(f, "ds1821_%s_seconds_bucket{sensor=\"%s\",gpio=\"%d\",le=\"+Inf\"} %lu\n",
+                    stage_info[st].name, sensors[i].name, sensors[i].data_pin, cum);
+            fprintf(f, "ds1821_%s_seconds_sum{sensor=\"%s\",gpio=\"%d\"} %.6f\n",
+                    stage_info[st].name, sensors[i].name, sensors[i].data_pin,
+                    m->sum_us[st] / 1e6);
+            fprintf(f, "ds1821_%s_seconds_count{sensor=\"%s\",gpio=\"%d\"} %lu\n",
+                    stage_info[st].name, sensors[i].name, sensors[i].data_pin,
+                    m->count[st]);
+        }
+    }
+
+    static const struct {
+        const char *name, *help;
+        size_t off;
+    } counters[] = {
+        { "no_presence", "Resets with no presence pulse.",
+          offsetof(struct ow_metrics, no_presence) },
+        { "crc_errors",  "ROM codes read with a bad CRC.",
+          offsetof(struct ow_metrics, crc_errors) },
+        { "read_errors", "Readings that failed.",
+          offsetof(struct ow_metrics, read_errors) },
+        { "readings",    "Readings published.",
+          offsetof(struct ow_metrics, readings) },
+        { "timing_fallbacks", "Timing profile fallbacks to standard.",
+          offsetof(struct ow_metrics, timing_fallbacks) },
+        { "retries",     "Bus transactions repeated after a bad read.",
+          offsetof(struct ow_metrics, retries) },
+        { "tout_changes", "TOUT transitions seen between cycles.",
+          offsetof(struct ow_metrics, tout_changes) },
+        { "unchanged",   "Readings held back by the publish policy.",
+          offsetof(struct ow_metrics, unchanged) },
+    };
+    for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+        fprintf(f, "# HELP ds1821_%s_total %s\n", counters[c].name, counters[c].help);
+        fprintf(f, "# TYPE ds1821_%s_total counter\n", counters[c].name);
+        for (int i = 0; i < n_sensors; i++) {
+            const unsigned long *v = (const unsigned long *)
+                ((const char *)sensors[i].metrics + counters[c].off);
+            fprintf(f, "ds1821_%s_total{sensor=\"%s\",gpio=\"%d\"} %lu\n",
+                    counters[c].name, sensors[i].name, sensors[i].data_pin,
+                    __atomic_load_n(v, __ATOMIC_RELAXED));
+        }
+    }
 
-            /* Write direction bit to select that branch */
-            ow_write_bit(dir);
+    fprintf(f, "# HELP ds1821_interval_seconds Current time between readings.\n"
+               "# TYPE ds1821_interval_seconds gauge\n");
+    for (int i = 0; i < n_sensors; i++)
+        fprintf(f, "ds1821_interval_seconds{sensor=\"%s\",gpio=\"%d\"} %d\n",
+                sensors[i].name, sensors[i].data_pin, sensors[i].every);
+
+    if (push_url) {
+        pthread_mutex_lock(&push_lock);
+        unsigned long queued = push_head - push_tail, sent = push_sent,
+                      dropped = push_dropped;
+        pthread_mutex_unlock(&push_lock);
+        fprintf(f, "# HELP ds1821_push_queued Messages waiting for --push.\n"
+                   "# TYPE ds1821_push_queued gauge\n"
+                   "ds1821_push_queued %lu\n"
+                   "# HELP ds1821_push_sent_total Messages delivered by --push.\n"
+                   "# TYPE ds1821_push_sent_total counter\n"
+                   "ds1821_push_sent_total %lu\n"
+                   "# HELP ds1821_push_dropped_total Messages dropped from a full --push queue.\n"
+                   "# TYPE ds1821_push_dropped_total counter\n"
+                   "ds1821_push_dropped_total %lu\n", queued, sent, dropped);
+    }
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* ── Power-gated round-robin ─────────────────────────────────────── */
+
+/*
+ * DS1821s that share a data pin each need their own power pin: only the
+ * one whose turn it is may be powered, or they all answer at once.  A
+ * cycle runs in rounds.  Round k powers up the k-th sensor of every
+ * shared pin, together with every unshared sensor in round 0, and
+ * waits for all of them to answer a reset.  The round then reads the
+ * whole set through read_batch() with one shared conversion wait, and
+ * powers the gated sensors down again.  Conversions on different pins
+ * overlap, so each round costs one power-up plus one conversion, however
+ * many pins are configured.
+ *
+ * Power-up of the next sensor can't overlap the current one's
+ * conversion on the same pin: both would be live on DQ when the
+ * result is read back.
+ */
+
+static int n_rounds = 1;
+
+/* Find shared data pins and give each of their sensors a turn */
+static int plan_power_rounds(void)
+{
+    n_rounds = 1;
+    for (int i = 0; i < n_sensors; i++) {
+        int pos = 0, shared = 0;
+        for (int j = 0; j < n_sensors; j++) {
+            if (j == i || sensors[j].data_pin != sensors[i].data_pin)
+                continue;
+            shared = 1;
+            if (j < i)
+                pos++;
         }
+        sensors[i].gated = shared;
+        sensors[i].group_pos = shared ? pos : 0;
+        if (shared && sensors[i].power_pin < 0) {
+            fprintf(stderr, "Sensor '%s' shares GPIO%d and needs a power pin\n",
+                    sensors[i].name, sensors[i].data_pin);
+            return -1;
+        }
+        if (pos + 1 > n_rounds)
+            n_rounds = pos + 1;
+    }
+    return 0;
+}
 
-        if (!done) {
-            memcpy(roms[device_count], rom, 8);
-            device_count++;
+static void set_sensor_power(struct sensor *s, int on)
+{
+    bus_power(s->power_pin, on);
+    if (!on)
+        s->off_at_us = now_us();
+}
+
+/*
+ * ds1821_power_up_wait() for a set of sensors on different pins,
+ * polled in turn, so the set costs the slowest one.
+ */
+static void power_up_wait_batch(struct sensor *const *list, int n)
+{
+    long long start = now_us();
+    int pending[MAX_SENSORS], left = n;
+
+    for (int i = 0; i < n; i++) {
+        pending[i] = 1;
+        select_sensor(list[i]);
+        ow->release();
+    }
+
+    while (left > 0 && now_us() - start < POR_TIMEOUT_US) {
+        bus_wait_us(POR_POLL_US);
+        for (int i = 0; i < n; i++) {
+            if (!pending[i])
+                continue;
+            select_sensor(list[i]);
+            if (ow->reset()) {
+                metrics_observe(STAGE_POWERUP, now_us() - start);
+                pending[i] = 0;
+                left--;
+            }
         }
+    }
 
-        last_discrepancy = new_discrepancy;
-        if (last_discrepancy < 0)
-            done = 1;  /* No more discrepancies — all devices found */
+    for (int i = 0; i < n; i++) {
+        if (pending[i]) {
+            select_sensor(list[i]);
+            metrics_observe(STAGE_POWERUP, now_us() - start);
+        }
+    }
+}
+
+/* Timing self-test, once per sensor, while it is powered */
+static void sensor_self_test(struct sensor *s)
+{
+    if (s->self_tested)
+        return;
+    select_sensor(s);
+    timing_self_test();
+    s->timing = tm;
+    s->self_tested = 1;
+}
+
+/*
+ * Power up the sensors of one round and list them (idx[] gets their
+ * index in sensors[]).  Returns how many there are.
+ */
+static int round_begin(int round, struct sensor **list, int *idx)
+{
+    struct sensor *gated[MAX_SENSORS];
+    int n = 0, ng = 0;
+    long off_left = 0;
+
+    for (int i = 0; i < n_sensors; i++) {
+        if (sensors[i].gated ? sensors[i].group_pos != round : round != 0)
+            continue;
+        if (sensors[i].idle)
+            continue;
+        if (sensors[i].gated) {
+            /* Honour off_ms since it was last switched off */
+            long left = sensors[i].off_ms * 1000L - (now_us() - sensors[i].off_at_us);
+            if (sensors[i].off_at_us && left > off_left)
+                off_left = left;
+            gated[ng++] = &sensors[i];
+        }
+        idx[n] = i;
+        list[n++] = &sensors[i];
+    }
+
+    if (off_left > 0)
+        bus_wait_us(off_left);
+    for (int k = 0; k < ng; k++)
+        set_sensor_power(gated[k], 1);
+    if (ng)
+        power_up_wait_batch(gated, ng);
+    for (int k = 0; k < n; k++)
+        sensor_self_test(list[k]);
+    return n;
+}
+
+/* Power the round's gated sensors down again */
+static void round_end(struct sensor *const *list, int n)
+{
+    for (int k = 0; k < n; k++) {
+        if (!list[k]->gated)
+            continue;
+        set_sensor_power(list[k], 0);
+        select_sensor(list[k]);
+        ow->release();
+    }
+}
+
+/*
+ * Startup for the daemon and provision: unshared sensors are powered
+ * for good, with one power-up wait for the whole set; gated ones wait for
+ * their turn.
+ */
+static void sensors_power_up(void)
+{
+    struct sensor *powered[MAX_SENSORS];
+    int np = 0;
+
+    for (int i = 0; i < n_sensors; i++) {
+        select_sensor(&sensors[i]);
+        ow->release();
+        if (power_pin >= 0) {
+            set_sensor_power(&sensors[i], !sensors[i].gated);
+            if (!sensors[i].gated)
+                powered[np++] = &sensors[i];
+        }
+    }
+
+    if (np)
+        power_up_wait_batch(powered, np);
+
+    for (int i = 0; i < n_sensors; i++)
+        if (!sensors[i].gated)
+            sensor_self_test(&sensors[i]);
+}
+
+/* ── History log ─────────────────────────────────────────────────── */
+
+/*
+ * With --history-dir, the daemon appends every reading to
+ * <dir>/<name>.hist, a fixed-size file it keeps mapped.  The file holds
+ * three rings: raw readings, 15-minute buckets and one-day buckets
+ * (min, max and sum of millideg).  Each reading goes into the raw ring
+ * and into the open bucket of both coarser rings, so by the time a raw
+ * reading is overwritten its summary is already on disk.
+ *
+ * The file never grows.  At 640 KiB per sensor it covers 5.7 days raw
+ * at a 60 s interval, 85 days in 15-minute buckets and 22 years in
+ * days, and a cycle dirties at most three pages, which the kernel
+ * writes back in one go.
+ */
+
+#define HIST_MAGIC         0x54534948u  /* "HIST" little-endian */
+#define HIST_VERSION       1
+#define HIST_RAW_SLOTS     8192
+#define HIST_BUCKET_SLOTS  8192
+#define HIST_TIERS         2
+
+static const uint32_t hist_bucket_s[HIST_TIERS] = { 900, 86400 };
+
+struct hist_raw {               /* one reading, 16 bytes */
+    int64_t time_ns;            /* CLOCK_REALTIME */
+    int32_t millideg;
+    int8_t  temp;
+    uint8_t count_remain;
+    uint8_t count_per_c;
+    uint8_t status;
+};
+
+struct hist_bucket {            /* one interval, 32 bytes */
+    int64_t  start;             /* Unix seconds, a multiple of bucket_s */
+    int64_t  sum;               /* of millideg */
+    int32_t  min, max;
+    uint32_t count;
+    uint32_t pad;
+};
+
+struct hist_tier {
+    uint64_t head;              /* buckets opened; the open one is head - 1 */
+    uint32_t bucket_s;
+    uint32_t pad;
+    struct hist_bucket b[HIST_BUCKET_SLOTS];
+};
+
+struct hist_log {
+    uint32_t magic, version;
+    uint32_t raw_slots, bucket_slots;
+    uint64_t raw_head;          /* readings written; newest is raw_head - 1 */
+    struct hist_raw raw[HIST_RAW_SLOTS];
+    struct hist_tier tier[HIST_TIERS];
+};
+
+static const char *history_dir = NULL;  /* --history-dir DIR */
+static const char *hist_from = "-1d";   /* --from T */
+static const char *hist_to = NULL;      /* --to T, NULL = now */
+
+static int hist_valid(const struct hist_log *h)
+{
+    if (h->magic != HIST_MAGIC || h->version != HIST_VERSION ||
+        h->raw_slots != HIST_RAW_SLOTS || h->bucket_slots != HIST_BUCKET_SLOTS)
+        return 0;
+    for (int k = 0; k < HIST_TIERS; k++)
+        if (h->tier[k].bucket_s != hist_bucket_s[k])
+            return 0;
+    return 1;
+}
+
+/*
+ * Map a log read-write, creating it if it doesn't exist.  Unlike the
+ * ring, a file with another layout is left alone: it may hold years of
+ * readings.
+ */
+static struct hist_log *hist_create(const char *dir, const char *name)
+{
+    char path[512];
+    if (snprintf(path, sizeof(path), "%s/%s.hist", dir, name) >= (int)sizeof(path))
+        return NULL;
+
+    mkdir(dir, 0755);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "Cannot stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    int fresh = st.st_size == 0;
+    if (!fresh && st.st_size != (off_t)sizeof(struct hist_log)) {
+        fprintf(stderr, "%s: not a version %d history log, leaving it alone\n",
+                path, HIST_VERSION);
+        close(fd);
+        return NULL;
+    }
+    if (fresh && ftruncate(fd, sizeof(struct hist_log)) < 0) {
+        fprintf(stderr, "Cannot size %s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, sizeof(struct hist_log), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct hist_log *h = p;
+    if (fresh) {
+        h->version      = HIST_VERSION;
+        h->raw_slots    = HIST_RAW_SLOTS;
+        h->bucket_slots = HIST_BUCKET_SLOTS;
+        for (int k = 0; k < HIST_TIERS; k++)
+            h->tier[k].bucket_s = hist_bucket_s[k];
+        __atomic_store_n(&h->magic, HIST_MAGIC, __ATOMIC_RELEASE);
+    } else if (!hist_valid(h)) {
+        fprintf(stderr, "%s: not a version %d history log, leaving it alone\n",
+                path, HIST_VERSION);
+        munmap(p, sizeof(struct hist_log));
+        return NULL;
+    }
+    return h;
+}
+
+/* Map a log read-only.  Returns NULL if it is missing or not a log. */
+static const struct hist_log *hist_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == (off_t)sizeof(struct hist_log))
+        p = mmap(NULL, sizeof(struct hist_log), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    if (!hist_valid(p)) {
+        munmap(p, sizeof(struct hist_log));
+        return NULL;
+    }
+    return p;
+}
+
+/*
+ * Append one reading.  Single writer; a reader may see the newest
+ * bucket one reading behind.  A clock that steps back keeps adding to
+ * the open bucket rather than reopening an old one.
+ */
+static void hist_append(struct hist_log *h, const struct ds1821_reading *r)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    struct hist_raw *e = &h->raw[h->raw_head % HIST_RAW_SLOTS];
+    e->time_ns      = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    e->millideg     = r->millideg;
+    e->temp         = r->temp;
+    e->count_remain = r->count_remain;
+    e->count_per_c  = r->count_per_c;
+    e->status       = r->status;
+    __atomic_store_n(&h->raw_head, h->raw_head + 1, __ATOMIC_RELEASE);
+
+    for (int k = 0; k < HIST_TIERS; k++) {
+        struct hist_tier *t = &h->tier[k];
+        int64_t start = ts.tv_sec - ts.tv_sec % t->bucket_s;
+        struct hist_bucket *b = &t->b[(t->head + HIST_BUCKET_SLOTS - 1) % HIST_BUCKET_SLOTS];
+
+        if (t->head == 0 || start > b->start) {
+            b = &t->b[t->head % HIST_BUCKET_SLOTS];
+            b->start = start;
+            b->sum   = 0;
+            b->count = 0;
+            b->min   = b->max = r->millideg;
+            __atomic_store_n(&t->head, t->head + 1, __ATOMIC_RELEASE);
+        }
+        b->sum += r->millideg;
+        b->count++;
+        if (r->millideg < b->min) b->min = r->millideg;
+        if (r->millideg > b->max) b->max = r->millideg;
+    }
+}
+
+/* Daemon: log a published reading, mapping the sensor's log on first use */
+static int history_record(struct sensor *s, const struct ds1821_reading *r)
+{
+    if (!s->hist)
+        s->hist = hist_create(history_dir, s->name);
+    if (!s->hist)
+        return -1;
+    hist_append(s->hist, r);
+    return 0;
+}
+
+/* "-N[smhd]" is N seconds (minutes, ...) before now, "N" Unix seconds */
+static int parse_time_arg(const char *arg, int64_t now, int64_t *out)
+{
+    char *end;
+    long long v = strtoll(arg, &end, 10);
+    if (end == arg)
+        return -1;
+
+    int64_t unit = 1;
+    switch (*end) {
+    case 'd': unit *= 24;   /* fall through */
+    case 'h': unit *= 60;   /* fall through */
+    case 'm': unit *= 60;   /* fall through */
+    case 's': end++;        /* fall through */
+    case '\0': break;
+    default: return -1;
+    }
+    if (*end)
+        return -1;
+
+    *out = arg[0] == '-' ? now + v * unit : v * unit;
+    return 0;
+}
+
+static void hist_print(const char *name, int64_t t, int32_t mean,
+                       int32_t min, int32_t max, uint32_t n)
+{
+    char buf[32];
+    time_t tt = (time_t)t;
+    struct tm tmv;
+    gmtime_r(&tt, &tmv);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tmv);
+    printf("%s %-16s %7d %7d %7d %5u\n", buf, name, mean, min, max, n);
+}
+
+/*
+ * Print one sensor's readings in [from, to] from the finest ring that
+ * still reaches back to from (or has never wrapped): raw readings for
+ * the last few days, buckets before that.
+ */
+static void hist_query(const char *name, const struct hist_log *h,
+                       int64_t from, int64_t to)
+{
+    uint64_t head = __atomic_load_n(&h->raw_head, __ATOMIC_ACQUIRE);
+    uint64_t n = head < HIST_RAW_SLOTS ? head : HIST_RAW_SLOTS;
+
+    if (head <= HIST_RAW_SLOTS ||
+        h->raw[(head - n) % HIST_RAW_SLOTS].time_ns / 1000000000 <= from) {
+        for (uint64_t i = head - n; i < head; i++) {
+            const struct hist_raw *e = &h->raw[i % HIST_RAW_SLOTS];
+            int64_t t = e->time_ns / 1000000000;
+            if (t >= from && t <= to)
+                hist_print(name, t, e->millideg, e->millideg, e->millideg, 1);
+        }
+        return;
+    }
+
+    int k = 0;
+    for (; k < HIST_TIERS - 1; k++) {
+        const struct hist_tier *t = &h->tier[k];
+        uint64_t th = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+        if (th <= HIST_BUCKET_SLOTS ||
+            t->b[(th - HIST_BUCKET_SLOTS) % HIST_BUCKET_SLOTS].start <= from)
+            break;
+    }
+
+    const struct hist_tier *t = &h->tier[k];
+    head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+    n = head < HIST_BUCKET_SLOTS ? head : HIST_BUCKET_SLOTS;
+    for (uint64_t i = head - n; i < head; i++) {
+        const struct hist_bucket *b = &t->b[i % HIST_BUCKET_SLOTS];
+        if (b->count == 0 || b->start + t->bucket_s <= from || b->start > to)
+            continue;
+        hist_print(name, b->start, (int32_t)(b->sum / (int64_t)b->count),
+                   b->min, b->max, b->count);
+    }
+}
+
+static int hist_filter(const struct dirent *d)
+{
+    size_t len = strlen(d->d_name);
+    return d->d_name[0] != '.' && len > 5 && strcmp(d->d_name + len - 5, ".hist") == 0;
+}
+
+/*
+ * history action — print logged readings between --from and --to,
+ * for one sensor or every log in the history directory.  Needs neither
+ * pigpio nor root.
+ */
+static int action_history(const char *name)
+{
+    const char *dir = history_dir ? history_dir : DEFAULT_HISTORY_DIR;
+    int64_t now = time(NULL), from, to = now;
+
+    if (parse_time_arg(hist_from, now, &from) < 0 ||
+        (hist_to && parse_time_arg(hist_to, now, &to) < 0)) {
+        fprintf(stderr, "Bad time: use Unix seconds or -N[smhd] (e.g. -7d)\n");
+        return -1;
+    }
+
+    struct dirent **ent = NULL;
+    int nent = 0;
+    if (!name) {
+        nent = scandir(dir, &ent, hist_filter, alphasort);
+        if (nent < 0) {
+            fprintf(stderr, "Cannot read %s: %s\n", dir, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (!quiet)
+        printf("# time                sensor              mean     min     max     n  (m°C)\n");
+
+    int found = 0;
+    for (int i = 0; i < (name ? 1 : nent); i++) {
+        char path[512], sname[64];
+        if (name)
+            snprintf(sname, sizeof(sname), "%s", name);
+        else
+            snprintf(sname, sizeof(sname), "%.*s",
+                     (int)(strlen(ent[i]->d_name) - 5), ent[i]->d_name);
+        snprintf(path, sizeof(path), "%s/%s.hist", dir, sname);
+
+        const struct hist_log *h = hist_open(path);
+        if (!h) {
+            fprintf(stderr, "Cannot open history log %s\n", path);
+            continue;
+        }
+        hist_query(sname, h, from, to);
+        munmap((void *)h, sizeof(struct hist_log));
+        found++;
+    }
+
+    for (int i = 0; i < nent; i++)
+        free(ent[i]);
+    free(ent);
+
+    if (!found) {
+        if (!name)
+            fprintf(stderr, "No history logs in %s\n", dir);
+        return -1;
+    }
+    return 0;
+}
+
+/* ── TOUT watch ──────────────────────────────────────────────────── */
+
+/*
+ * With --watch-tout, every always-powered sensor with read-tout set has
+ * a pigpio alert on its DQ/TOUT pin between cycles.  pigpio's sampler
+ * reports each edge with its tick, and the callback (on pigpio's alert
+ * thread) publishes it at once: "tout" gets the new level and
+ * "tout_changed" gets "<unix ns> <level>".  Nothing polls, and nothing
+ * is sent on the bus.
+ *
+ * Bus traffic is edges too, so the alerts are switched off for the
+ * length of each cycle.  The level is re-read when they're switched
+ * back on, which catches a trip that happened during the cycle.
+ */
+
+static int watch_tout = 0;      /* --watch-tout */
+
+static void publish_tout(struct sensor *s, int level, long long ns)
+{
+    char dir[512], buf[64];
+
+    if (snprintf(dir, sizeof(dir), "%s/%s", run_dir, s->name) >= (int)sizeof(dir))
+        return;
+    mkdir(dir, 0755);
+    snprintf(buf, sizeof(buf), "%d", level);
+    write_run_file(dir, "tout", buf);
+    snprintf(buf, sizeof(buf), "%lld %d", ns, level);
+    write_run_file(dir, "tout_changed", buf);
+    /* May run on pigpio's alert thread while write_metrics() reads it */
+    __atomic_fetch_add(&s->metrics->tout_changes, 1, __ATOMIC_RELAXED);
+}
+
+static long long realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void tout_alert(int gpio, int level, uint32_t tick, void *user)
+{
+    struct sensor *s = user;
+
+    (void)gpio;
+    if (level > 1 || level == s->tout_level)
+        return;     /* watchdog, or no change */
+    s->tout_level = level;
+
+    /* Back-date to the sampled edge; ticks are µs and wrap together */
+    uint32_t age_us = gpioTick() - tick;
+    publish_tout(s, level, realtime_ns() - age_us * 1000LL);
+}
+
+static int tout_watched(const struct sensor *s)
+{
+    return s->read_tout && !s->gated;
+}
+
+/* Switch the alerts on (after a cycle) or off (before one) */
+static void tout_watch(int on)
+{
+    for (int i = 0; i < n_sensors; i++) {
+        struct sensor *s = &sensors[i];
+        if (!tout_watched(s))
+            continue;
+        if (!on) {
+            gpioSetAlertFuncEx(s->data_pin, NULL, NULL);
+            continue;
+        }
+
+        gpioSetMode(s->data_pin, PI_INPUT);
+        gpioSetPullUpDown(s->data_pin, PI_PUD_OFF);
+        int level = gpioRead(s->data_pin);
+        if (s->tout_level >= 0 && level != s->tout_level)
+            publish_tout(s, level, realtime_ns());
+        s->tout_level = level;
+        gpioSetAlertFuncEx(s->data_pin, tout_alert, s);
+    }
+}
+
+/* ── Adaptive sampling ───────────────────────────────────────────── */
+
+/*
+ * Each sensor has its own interval, interval=MIN[:MAX] in sensors.conf
+ * (default: --interval).  With MAX above MIN, the interval follows the
+ * sensor's recent rate of change, from the hi-res millideg of
+ * consecutive readings: it aims for ADAPT_STEP_MDEG (or delta=) of
+ * change per reading.  A faster change shortens it at once; a calmer
+ * reading at most doubles it, so a sudden swing after a quiet spell
+ * is caught on the next reading.  The rate itself jumps up with a
+ * bigger change and halves its way down.
+ *
+ * A cycle reads every sensor due within DUE_SLACK_NS, so sensors that
+ * are nearly due share one conversion wait instead of two cycles.
+ */
+
+#define ADAPT_STEP_MDEG  100                    /* aimed-for change per reading */
+#define DUE_SLACK_NS     1000000000LL
+
+static long long mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* After a cycle that was due: adapt the interval (r == NULL if it failed) */
+static void schedule_next(struct sensor *s, const struct ds1821_reading *r, long long now)
+{
+    if (r && s->last_ns && now > s->last_ns && s->every_max > s->every_min) {
+        double inst = abs(r->millideg - s->last_md) * 1e9 / (double)(now - s->last_ns);
+        s->rate = inst > s->rate ? inst : (s->rate + inst) / 2;
+
+        int step = s->delta > 0 ? s->delta : ADAPT_STEP_MDEG;
+        double want = s->rate > 0 ? step / s->rate : s->every_max;
+        int next = want >= s->every_max ? s->every_max :
+                   want <= s->every_min ? s->every_min : (int)want;
+        s->every = next > 2 * s->every ? 2 * s->every : next;
+    }
+    if (r) {
+        s->last_md = r->millideg;
+        s->last_ns = now;
+    }
+
+    /* Keep the phase; only a daemon that fell behind starts afresh */
+    s->due_ns += s->every * 1000000000LL;
+    if (s->due_ns <= now)
+        s->due_ns = now + s->every * 1000000000LL;
+}
+
+/* Mark who is due now */
+static void schedule_due(long long now)
+{
+    for (int i = 0; i < n_sensors; i++)
+        sensors[i].idle = sensors[i].due_ns > now + DUE_SLACK_NS;
+}
+
+/* When the next cycle is due */
+static long long schedule_wake(void)
+{
+    long long t = sensors[0].due_ns;
+    for (int i = 1; i < n_sensors; i++)
+        if (sensors[i].due_ns < t)
+            t = sensors[i].due_ns;
+    return t;
+}
+
+/* ── Control socket ──────────────────────────────────────────────── */
+
+/*
+ * ds1821d listens on <run_dir>/ds1821d.sock.  When it is up, the CLI
+ * sends probe, temp, status, set-th and set-tl there instead of
+ * starting pigpio itself.  The daemon runs them between cycles on its
+ * sensor with that data GPIO, or the one named by --sensor, so an
+ * interactive command queues behind the scheduler rather than fail.
+ * One request per connection, on one line:
+ *
+ *     <probe|temp|status|set> gpio=N quiet=0|1 verbose=0|1 tout=0|1
+ *         [th=N] [tl=N] [sensor=NAME] [engine=E] [power=N] [tx=N]
+ *         [w1=N] [w1dev=ID] [timing=T] [retries=N] [poll=1]
+ *
+ * engine, power, tx, w1 and w1dev are sent only when they were given on
+ * the command line, and must all match the daemon's sensor.  If none
+ * does, the exit code is CTL_NOT_HERE and the CLI runs the action
+ * itself, with the bus lock keeping it off the daemon's buses.  timing,
+ * retries, poll and tout apply to that one request.
+ *
+ * The reply is the action's stdout and stderr as a local run would
+ * print them, then a NUL byte and the exit code.
+ */
+
+#define CTL_SOCK          "ds1821d.sock"
+#define CTL_REQ_TIMEOUT_S 2     /* daemon: to read the request line */
+#define CTL_TIMEOUT_S     120   /* client: cycles ahead of it, then the action */
+#define CTL_NOT_HERE      (-1)  /* exit code: no such bus here, run it locally */
+
+/* Options given on the command line, so only those are sent */
+enum {
+    CTL_ENGINE = 1 << 0, CTL_POWER = 1 << 1, CTL_TX = 1 << 2, CTL_W1M = 1 << 3,
+    CTL_W1DEV = 1 << 4, CTL_TIMING = 1 << 5, CTL_RETRIES = 1 << 6,
+};
+
+struct ctl_req {
+    const char *action, *name, *engine, *w1dev, *timing;
+    int gpio, th, tl, tout, poll;
+    int power, tx, w1m, retries;
+    unsigned given;         /* CTL_* keys in the request */
+};
+
+static int ctl_fd = -1;
+static const char *ctl_sensor = NULL;   /* --sensor NAME */
+static unsigned ctl_given = 0;          /* CTL_* options on the command line */
+
+static int ctl_addr(struct sockaddr_un *sa)
+{
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    return snprintf(sa->sun_path, sizeof(sa->sun_path), "%s/%s", run_dir, CTL_SOCK)
+           < (int)sizeof(sa->sun_path) ? 0 : -1;
+}
+
+/* Daemon: start listening.  Failing to is only a warning. */
+static void ctl_listen(void)
+{
+    struct sockaddr_un sa;
+    if (ctl_addr(&sa) < 0)
+        return;
+    mkdir(run_dir, 0755);
+
+    /* A socket someone still answers on belongs to another daemon */
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
+        fprintf(stderr, "ds1821d: %s is served by another daemon; not listening\n", sa.sun_path);
+        close(probe);
+        return;
+    }
+    if (probe >= 0)
+        close(probe);
+    unlink(sa.sun_path);
+
+    ctl_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ctl_fd < 0 || bind(ctl_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        chmod(sa.sun_path, 0660) < 0 || listen(ctl_fd, 16) < 0) {
+        fprintf(stderr, "ds1821d: cannot listen on %s: %s\n", sa.sun_path, strerror(errno));
+        if (ctl_fd >= 0)
+            close(ctl_fd);
+        ctl_fd = -1;
+        return;
+    }
+    signal(SIGPIPE, SIG_IGN);   /* a client that hangs up mid-reply */
+}
+
+static void ctl_close(void)
+{
+    struct sockaddr_un sa;
+    if (ctl_fd < 0)
+        return;
+    close(ctl_fd);
+    ctl_fd = -1;
+    if (ctl_addr(&sa) == 0)
+        unlink(sa.sun_path);
+}
+
+/*
+ * Sleep until wake (CLOCK_MONOTONIC ns).  Returns 1 early when a client
+ * is waiting, 0 when it's time for the next cycle or time to stop.
+ */
+static int ctl_wait(long long wake)
+{
+    for (;;) {
+        long long left = wake - mono_ns();
+        if (left <= 0 || !keep_running)
+            return 0;
+        if (ctl_fd < 0) {
+            struct timespec ts = { .tv_sec = wake / 1000000000, .tv_nsec = wake % 1000000000 };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            continue;
+        }
+        struct pollfd p = { .fd = ctl_fd, .events = POLLIN };
+        if (poll(&p, 1, (int)((left + 999999) / 1000000)) > 0)
+            return 1;
     }
-
-    return device_count;
 }
 
-
-/* ── Actions ─────────────────────────────────────────────────────── */
-
-static int action_scan(void)
+/* Does the sensor sit on the bus the request's options select? */
+static int ctl_bus_match(const struct sensor *s, const struct ctl_req *rq)
 {
-    printf("\n=== Scanning 1-Wire bus on GPIO%d ===\n\n", gpio_pin);
+    return (!(rq->given & CTL_POWER) || s->power_pin == rq->power) &&
+           (!(rq->given & CTL_TX) || s->tx_pin == rq->tx) &&
+           (!(rq->given & CTL_W1M) || s->w1_master == rq->w1m) &&
+           (!(rq->given & CTL_W1DEV) || strcmp(s->w1_device, rq->w1dev) == 0);
+}
 
-    /* First: basic presence check */
-    printf("  1. Presence check...\n");
-    if (!ow_reset()) {
-        printf("     No presence pulse — no devices responding at all.\n");
-        printf("     Check wiring: DQ→GPIO%d, 4.7kΩ pullup to 3.3V, GND.\n",
-               gpio_pin);
-        return -1;
+/* Run one request on the bus.  Returns the exit code for the client. */
+static int ctl_run(const struct ctl_req *rq)
+{
+    const char *action = rq->action, *name = rq->name;
+    int th = rq->th, tl = rq->tl;
+
+    if ((rq->given & CTL_ENGINE) && strcmp(rq->engine, ow->name) != 0)
+        return CTL_NOT_HERE;
+
+    struct sensor *s = NULL;
+    for (int i = 0; i < n_sensors && !s; i++)
+        if (name ? strcmp(sensors[i].name, name) == 0 :
+                   sensors[i].data_pin == rq->gpio && ctl_bus_match(&sensors[i], rq))
+            s = &sensors[i];
+    if (!s && !name)
+        return CTL_NOT_HERE;
+    if (!s) {
+        fprintf(stderr, "ds1821d: no sensor named %s\n", name);
+        return 1;
+    }
+    if (name && !ctl_bus_match(s, rq)) {
+        fprintf(stderr, "ds1821d: sensor %s is not on the bus given by the options\n", name);
+        return 1;
+    }
+    if (!name && s->gated) {
+        fprintf(stderr, "ds1821d: GPIO%d is shared; pick one with --sensor NAME\n", rq->gpio);
+        return 1;
     }
-    printf("     Presence pulse detected — at least one device on bus.\n\n");
 
-    /* Try Read ROM (only valid with exactly 1 device) */
-    printf("  2. Read ROM (single-device command)...\n");
-    uint8_t rom[8];
-    if (ow_read_rom(rom) == 0) {
-        uint8_t crc = ow_crc8(rom, 7);
-        if (crc == rom[7] && rom[0] != 0x00) {
-            printf("     Single device found:\n     ");
-            print_rom(rom);
-        } else {
-            printf("     Got garbled ROM (multi-device collision or thermostat mode):\n     ");
-            print_rom(rom);
-            printf("     This is expected with multiple devices or thermostat-mode DS1821s.\n");
-        }
+    const struct ow_timing *timing = NULL;
+    if ((rq->given & CTL_TIMING) && !(timing = find_timing(rq->timing))) {
+        fprintf(stderr, "ds1821d: unknown timing %s\n", rq->timing);
+        return 1;
     }
-    printf("\n");
 
-    /* Search ROM to find all 1-Wire mode devices */
-    printf("  3. Search ROM (multi-device enumeration)...\n");
-    uint8_t found_roms[16][8];
-    int count = ow_search_rom(found_roms, 16);
+    select_sensor(s);
+    read_tout_flag |= rq->tout;
+    if (timing)
+        tm = timing;
+    if (rq->given & CTL_RETRIES)
+        read_retries = rq->retries;
+    int save_poll = poll_done;
+    poll_done |= rq->poll;
+    if (s->gated) {
+        set_sensor_power(s, 1);
+        ow->release();
+        ds1821_power_up_wait();
+    }
 
-    if (count == 0) {
-        printf("     No devices found via Search ROM.\n");
-        printf("     If DS1821s are in thermostat mode, they won't respond to ROM commands.\n");
+    int ret;
+    if (strcmp(action, "probe") == 0)
+        ret = action_probe();
+    else if (strcmp(action, "temp") == 0)
+        ret = action_read_temp();
+    else if (strcmp(action, "status") == 0)
+        ret = action_status();
+    else if (strcmp(action, "set") == 0 && (th != NO_TARGET || tl != NO_TARGET)) {
+        ret = action_set_thresholds(th != NO_TARGET, tl != NO_TARGET,
+                                    (int8_t)th, (int8_t)tl);
+        s->cache.valid = 0;
     } else {
-        printf("     Found %d device(s):\n", count);
-        int valid = 0, phantom = 0;
-        for (int i = 0; i < count; i++) {
-            printf("     [%d] ", i + 1);
-            print_rom(found_roms[i]);
-            uint8_t crc = ow_crc8(found_roms[i], 7);
-            if (crc == found_roms[i][7] && found_roms[i][0] != 0x00)
-                valid++;
-            else
-                phantom++;
-        }
-        if (phantom > 0) {
-            printf("\n     %d phantom device(s) detected — likely DS1821(s) in thermostat mode\n", phantom);
-            printf("     driving the bus and creating false ROM codes.\n");
-        }
-        if (valid > 0) {
-            printf("\n     %d valid 1-Wire device(s) found.\n", valid);
-        }
+        fprintf(stderr, "ds1821d: bad request '%s'\n", action);
+        ret = -1;
     }
 
-    /* Probe thermostat-mode status (all respond simultaneously) */
-    printf("\n  4. Direct status read (thermostat-mode, no ROM)...\n");
-    printf("     Note: If multiple devices respond, bits are ANDed together.\n");
-    uint8_t status;
-    if (ds1821_read_status_reg(&status) == 0) {
-        print_status(status);
-        int8_t th, tl;
-        if (ds1821_read_th(&th) == 0 && ds1821_read_tl(&tl) == 0)
-            printf("\n  Alarm thresholds: TH=%d°C  TL=%d°C\n", th, tl);
+    if (s->gated) {
+        set_sensor_power(s, 0);
+        ow->release();
     }
+    poll_done = save_poll;
+    return ret < 0 ? 1 : 0;
+}
 
-    printf("\n  Summary:\n");
-    printf("  ─────────\n");
-    printf("  Presence:      YES\n");
-    printf("  ROM devices:   %d\n", count);
-    printf("  You said:      3 devices connected\n");
-    printf("\n  Next steps:\n");
-    printf("    sudo ./ds1821_program fix     — attempt to reprogram all to 1-Wire mode\n");
-    printf("    sudo ./ds1821_program temp    — read temperature (all respond at once)\n");
+/* A th=/tl= value from a request, or CTL_BAD_TEMP unless it is -55..125 */
+#define CTL_BAD_TEMP  1000
 
-    return 0;
+static int ctl_threshold(const char *s)
+{
+    char *end;
+    long v = strtol(s, &end, 10);
+    return end == s || *end || v < -55 || v > 125 ? CTL_BAD_TEMP : (int)v;
+}
+
+/* Daemon: answer one waiting client, with stdout and stderr sent to it */
+static void ctl_serve(int watching)
+{
+    int c = accept4(ctl_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (c < 0)
+        return;
+    struct timeval tv = { .tv_sec = CTL_REQ_TIMEOUT_S };
+    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char line[256];
+    size_t len = 0;
+    while (len < sizeof(line) - 1) {
+        ssize_t n = recv(c, line + len, sizeof(line) - 1 - len, 0);
+        if (n <= 0)
+            break;
+        len += n;
+        if (memchr(line, '\n', len))
+            break;
+    }
+    line[len] = '\0';
+
+    struct ctl_req rq = { .action = strtok(line, " \t\r\n"), .gpio = gpio_pin,
+                          .th = NO_TARGET, .tl = NO_TARGET };
+    int q = 1, v = 0;
+    for (char *tok = strtok(NULL, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+            continue;
+        *eq++ = '\0';
+        if (strcmp(tok, "gpio") == 0)         rq.gpio = atoi(eq);
+        else if (strcmp(tok, "th") == 0)      rq.th = ctl_threshold(eq);
+        else if (strcmp(tok, "tl") == 0)      rq.tl = ctl_threshold(eq);
+        else if (strcmp(tok, "tout") == 0)    rq.tout = atoi(eq);
+        else if (strcmp(tok, "poll") == 0)    rq.poll = atoi(eq);
+        else if (strcmp(tok, "quiet") == 0)   q = atoi(eq);
+        else if (strcmp(tok, "verbose") == 0) v = atoi(eq);
+        else if (strcmp(tok, "sensor") == 0)  rq.name = eq;
+        else if (strcmp(tok, "engine") == 0)  { rq.engine = eq; rq.given |= CTL_ENGINE; }
+        else if (strcmp(tok, "power") == 0)   { rq.power = atoi(eq); rq.given |= CTL_POWER; }
+        else if (strcmp(tok, "tx") == 0)      { rq.tx = atoi(eq); rq.given |= CTL_TX; }
+        else if (strcmp(tok, "w1") == 0)      { rq.w1m = atoi(eq); rq.given |= CTL_W1M; }
+        else if (strcmp(tok, "w1dev") == 0)   { rq.w1dev = eq; rq.given |= CTL_W1DEV; }
+        else if (strcmp(tok, "timing") == 0)  { rq.timing = eq; rq.given |= CTL_TIMING; }
+        else if (strcmp(tok, "retries") == 0) { rq.retries = atoi(eq); rq.given |= CTL_RETRIES; }
+    }
+
+    int save_quiet = quiet, save_verbose = verbose;
+    int out = dup(STDOUT_FILENO), err = dup(STDERR_FILENO);
+    fflush(stdout);
+    fflush(stderr);
+    dup2(c, STDOUT_FILENO);
+    dup2(c, STDERR_FILENO);
+    quiet = q;
+    verbose = v;
+
+    if (watching)
+        tout_watch(0);
+    int rc = 1;
+    if (rq.th == CTL_BAD_TEMP || rq.tl == CTL_BAD_TEMP)
+        fprintf(stderr, "ds1821d: threshold out of range (-55 to 125)\n");
+    else if (rq.action)
+        rc = ctl_run(&rq);
+    if (watching)
+        tout_watch(1);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(out, STDOUT_FILENO);
+    dup2(err, STDERR_FILENO);
+    close(out);
+    close(err);
+    quiet = save_quiet;
+    verbose = save_verbose;
+
+    char tail[16];
+    int n = snprintf(tail, sizeof(tail), "%c%d\n", 0, rc);
+    send(c, tail, n, MSG_NOSIGNAL);
+    close(c);
+}
+
+static void ctl_banner(void)
+{
+    if (quiet)
+        return;
+    if (ctl_sensor)
+        printf("DS1821 Direct Programmer — %s (via ds1821d)\n"
+               "──────────────────────────────────\n", ctl_sensor);
+    else
+        printf("DS1821 Direct Programmer — GPIO%d (via ds1821d)\n"
+               "──────────────────────────────────\n", gpio_pin);
 }
 
 /*
- * Read the TOUT state on the DQ/data pin.
- * In thermostat mode, DQ doubles as the thermostat output.
- * Returns 0 or 1 for the pin level, or -1 if not enabled.
+ * CLI: hand an action to a running daemon.  Returns its exit code, or
+ * -1 if no daemon is listening or it has no sensor on this bus (the
+ * caller then runs it locally).
  */
-static int read_tout(void)
+static int ctl_forward(const char *action, int has_th, int th, int has_tl, int tl)
 {
-    if (!read_tout_flag)
+    struct sockaddr_un sa;
+    if (ctl_addr(&sa) < 0)
         return -1;
-    gpioSetMode(gpio_pin, PI_INPUT);
-    gpioSetPullUpDown(gpio_pin, PI_PUD_OFF);
-    return gpioRead(gpio_pin);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        close(fd);
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = CTL_TIMEOUT_S };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char req[256];
+    int len = snprintf(req, sizeof(req), "%s gpio=%d quiet=%d verbose=%d tout=%d",
+                       (has_th || has_tl) ? "set" : action, gpio_pin, quiet, verbose,
+                       read_tout_flag);
+    if (has_th)
+        len += snprintf(req + len, sizeof(req) - len, " th=%d", th);
+    if (has_tl)
+        len += snprintf(req + len, sizeof(req) - len, " tl=%d", tl);
+    if (ctl_sensor)
+        len += snprintf(req + len, sizeof(req) - len, " sensor=%s", ctl_sensor);
+    if (ctl_given & CTL_ENGINE)
+        len += snprintf(req + len, sizeof(req) - len, " engine=%s", ow->name);
+    if (ctl_given & CTL_POWER)
+        len += snprintf(req + len, sizeof(req) - len, " power=%d", power_pin);
+    if (ctl_given & CTL_TX)
+        len += snprintf(req + len, sizeof(req) - len, " tx=%d", tx_pin);
+    if (ctl_given & CTL_W1M)
+        len += snprintf(req + len, sizeof(req) - len, " w1=%d", w1_master);
+    if (ctl_given & CTL_W1DEV)
+        len += snprintf(req + len, sizeof(req) - len, " w1dev=%s", w1_device);
+    if (ctl_given & CTL_TIMING)
+        len += snprintf(req + len, sizeof(req) - len, " timing=%s", tm->name);
+    if (ctl_given & CTL_RETRIES)
+        len += snprintf(req + len, sizeof(req) - len, " retries=%d", read_retries);
+    if (poll_done)
+        len += snprintf(req + len, sizeof(req) - len, " poll=1");
+    len += snprintf(req + len, sizeof(req) - len, "\n");
+
+    int rc = 1, in_tail = 0, banner = 0;
+    char buf[1024], code[16];
+    size_t ncode = 0;
+    if (len >= (int)sizeof(req) || send(fd, req, len, MSG_NOSIGNAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        ssize_t i = 0;
+        if (!in_tail) {
+            char *nul = memchr(buf, '\0', n);
+            i = nul ? nul - buf : n;
+            if (i > 0 && !banner++)
+                ctl_banner();
+            fwrite(buf, 1, i, stdout);
+            if (!nul)
+                continue;
+            in_tail = 1;
+            i++;
+        }
+        for (; i < n; i++)
+            if (ncode < sizeof(code) - 1)
+                code[ncode++] = buf[i];
+    }
+    close(fd);
+
+    code[ncode] = '\0';
+    if (in_tail && ncode)
+        rc = atoi(code);
+    else
+        fprintf(stderr, "ds1821d hung up without an answer\n");
+    if (rc == CTL_NOT_HERE) {
+        if (verbose)
+            fprintf(stderr, "ds1821d has no sensor on this bus; running locally\n");
+        return -1;
+    }
+    if (!banner)
+        ctl_banner();
+    return rc;
 }
 
-static int action_probe(void)
+/* ── Daemon cycle ────────────────────────────────────────────────── */
+
+/*
+ * Publish policy.  With neither delta= nor heartbeat= set, every reading
+ * rewrites every file.  Otherwise a file is only rewritten when its value
+ * changes, and temperature only once it has moved delta= m°C from the
+ * published value.  Alarm flag, threshold and TOUT changes always go out
+ * at once, and heartbeat= N rewrites everything when temperature has
+ * been left alone for N s, so a quiet sensor can be told from a dead one.
+ * Returns the PUB_* files this reading needs.
+ */
+static unsigned publish_due(const struct sensor *s, const struct ds1821_reading *r)
 {
-    if (!quiet)
-        printf("\n=== Probing DS1821 on GPIO%d ===\n\n", gpio_pin);
+    const struct ds1821_reading *p = &s->pub;
+
+    if ((s->delta < 0 && s->heartbeat == 0) || s->pub_at_us == 0)
+        return PUB_ALL;
+    if (s->heartbeat > 0 && now_us() - s->pub_at_us >= s->heartbeat * 1000000LL)
+        return PUB_ALL;
+
+    unsigned files = 0;
+    int moved = r->millideg - p->millideg;
+    if (moved < 0)
+        moved = -moved;
+    if (moved > 0 && moved >= s->delta)
+        files |= PUB_TEMP;
+    if ((r->status ^ p->status) & (DS1821_STATUS_THF | DS1821_STATUS_TLF))
+        files |= PUB_ALARMS;
+    if (r->have_th && (!p->have_th || r->th != p->th || r->tl != p->tl))
+        files |= PUB_THRESH;
+    if (r->tout >= 0 && r->tout != p->tout)
+        files |= PUB_TOUT;
+    return files;
+}
 
-    uint8_t status;
-    if (ds1821_read_status_reg(&status) < 0)
-        return -1;
+/* Remember what publish_reading() wrote */
+static void publish_done(struct sensor *s, const struct ds1821_reading *r, unsigned files)
+{
+    if (files & PUB_TEMP) {
+        s->pub.millideg = r->millideg;
+        s->pub_at_us = now_us();
+    }
+    if (files & PUB_ALARMS)
+        s->pub.status = r->status;
+    if ((files & PUB_THRESH) && r->have_th) {
+        s->pub.th = r->th;
+        s->pub.tl = r->tl;
+        s->pub.have_th = 1;
+    }
+    if (files & PUB_TOUT)
+        s->pub.tout = r->tout;
+}
 
-    int8_t th = 0, tl = 0;
-    int have_thresholds = (ds1821_read_th(&th) == 0 && ds1821_read_tl(&tl) == 0);
-    int tout = read_tout();
+/*
+ * --push: one JSON message for the whole cycle, with every sensor whose
+ * reading the publish policy let through.  Nothing is queued if none did.
+ */
+static void push_cycle(const struct ds1821_reading *r, const unsigned *files)
+{
+    size_t max = 128 + (size_t)n_sensors * 224, len = 0;
+    char *msg = malloc(max);
+    int n = 0;
+    if (!msg)
+        return;
 
-    if (quiet) {
-        /* Machine-readable key=value output */
-        printf("status=0x%02X\n", status);
-        printf("done=%d\n",   (status & DS1821_STATUS_DONE) ? 1 : 0);
-        printf("thf=%d\n",    (status & DS1821_STATUS_THF)  ? 1 : 0);
-        printf("tlf=%d\n",    (status & DS1821_STATUS_TLF)  ? 1 : 0);
-        printf("nvb=%d\n",    (status & DS1821_STATUS_NVB)  ? 1 : 0);
-        printf("oneshot=%d\n",(status & DS1821_STATUS_1SHOT)? 1 : 0);
-        if (have_thresholds) {
-            printf("th=%d\n", th);
-            printf("tl=%d\n", tl);
+    len += snprintf(msg + len, max - len, "{\"host\":\"%s\",\"time_ns\":%lld,\"readings\":[",
+                    push_hostname, realtime_ns());
+    for (int i = 0; i < n_sensors; i++) {
+        if (!files[i])
+            continue;
+        char name[2 * sizeof(sensors[i].name)];
+        size_t k = 0;
+        for (const char *c = sensors[i].name; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                name[k++] = '\\';
+            name[k++] = *c;
         }
-        if (tout >= 0)
-            printf("tout=%d\n", tout);
-    } else {
-        print_status(status);
-        if (have_thresholds)
-            printf("\n  Alarm thresholds: TH=%d°C  TL=%d°C\n", th, tl);
-        if (tout >= 0)
-            printf("  TOUT (DQ/GPIO%d): %s\n", gpio_pin,
-                   tout ? "HIGH (active)" : "LOW (inactive)");
+        name[k] = '\0';
+        len += snprintf(msg + len, max - len,
+                        "%s{\"sensor\":\"%s\",\"gpio\":%d,\"millideg\":%d,"
+                        "\"status\":%u,\"thf\":%d,\"tlf\":%d,\"tout\":%d}",
+                        n ? "," : "", name, sensors[i].data_pin, r[i].millideg,
+                        r[i].status, (r[i].status & DS1821_STATUS_THF) ? 1 : 0,
+                        (r[i].status & DS1821_STATUS_TLF) ? 1 : 0, r[i].tout);
+        n++;
     }
+    snprintf(msg + len, max - len, "]}");
 
-    return 0;
+    if (n)
+        push_enqueue(msg);
+    else
+        free(msg);
 }
 
-static int action_read_temp(void)
+/*
+ * Read every sensor that is due once and publish the results.
+ * Returns the number of sensors that failed.
+ */
+static int daemon_cycle(void)
 {
-    if (!quiet)
-        printf("\n=== Reading Temperature from DS1821 ===\n\n");
-
-    /* Start conversion */
-    if (!quiet) printf("  Starting conversion...\n");
-    if (ds1821_start_convert() < 0)
-        return -1;
-
-    /* Wait for conversion — DS1821 needs up to 1s */
-    usleep(1000000);
+    struct ds1821_reading r[MAX_SENSORS];
+    int ok[MAX_SENSORS] = { 0 };
+    unsigned pushed[MAX_SENSORS] = { 0 };
+    int errors = 0;
+
+    if (cache_flush) {
+        cache_flush = 0;
+        for (int i = 0; i < n_sensors; i++)
+            sensors[i].cache.valid = 0;
+    }
 
-    /* Check DONE */
-    uint8_t status;
-    if (ds1821_read_status_reg(&status) < 0)
-        return -1;
-    if (!(status & DS1821_STATUS_DONE) && !quiet) {
-        printf("  Warning: DONE bit not set, conversion may not be complete.\n");
+    for (int round = 0; round < n_rounds; round++) {
+        struct sensor *list[MAX_SENSORS];
+        int idx[MAX_SENSORS];
+        struct ds1821_reading rr[MAX_SENSORS];
+        int rok[MAX_SENSORS];
+        int n = round_begin(round, list, idx);
+        if (n == 0)
+            continue;   /* nobody in this round is due */
+
+        errors += read_batch(list, n, rr, rok);
+        for (int k = 0; k < n; k++) {
+            r[idx[k]] = rr[k];
+            ok[idx[k]] = rok[k];
+        }
+        round_end(list, n);
     }
 
-    /* Read temperature */
-    int8_t temp;
-    if (ds1821_read_temperature(&temp) < 0)
-        return -1;
+    long long now = mono_ns();
+    for (int i = 0; i < n_sensors; i++) {
+        if (sensors[i].idle)
+            continue;
+        schedule_next(&sensors[i], ok[i] ? &r[i] : NULL, now);
+        if (!ok[i])
+            continue;
+        unsigned files = publish_due(&sensors[i], &r[i]);
+        if (publish_reading(sensors[i].name, &r[i], &sensors[i].ring, files) < 0) {
+            errors++;
+            continue;
+        }
+        publish_done(&sensors[i], &r[i], files);
+        pushed[i] = files;
+        if (history_dir && history_record(&sensors[i], &r[i]) < 0)
+            errors++;
+        sensors[i].metrics->readings++;
+        if (!files)
+            sensors[i].metrics->unchanged++;
+        if (!quiet)
+            printf("  %-16s %6d m°C  (GPIO%d, conversion %ld ms)%s\n",
+                   sensors[i].name, r[i].millideg, sensors[i].data_pin,
+                   r[i].conv_us / 1000, files ? "" : "  unchanged");
+    }
 
-    /* Read counter and slope for high-res */
-    uint8_t count_remain, count_per_c;
-    if (ds1821_read_counter(&count_remain) < 0)
-        return -1;
-    if (ds1821_read_slope(&count_per_c) < 0)
-        return -1;
+    if (push_url)
+        push_cycle(r, pushed);
+    if (metrics_path && write_metrics(metrics_path) < 0)
+        errors++;
 
-    /* Calculate */
-    int cpc = count_per_c ? count_per_c : 1;
-    float hires = (float)temp - 0.25f +
-                  (float)(cpc - count_remain) / (float)cpc;
-    int millideg = (int)temp * 1000 - 250 +
-                   ((int)(cpc - count_remain) * 1000) / cpc;
+    if (!quiet)
+        fflush(stdout);
+    return errors;
+}
 
-    int tout = read_tout();
+/*
+ * Long-running mode: pigpio is initialised once by main(), every
+ * sensor stays powered, and each cycle only costs bus time.  With
+ * --once, run a single cycle and exit (used by ds1821-update).
+ */
+static int action_daemon(int interval, int once)
+{
+    sensors_power_up();
 
-    if (quiet) {
-        /* Machine-readable: just the temperature */
-        printf("%.2f\n", hires);
+    if (use_pigpio) {
+        gpioSetSignalFunc(SIGINT, sigterm_handler);
+        gpioSetSignalFunc(SIGTERM, sigterm_handler);
+        gpioSetSignalFunc(SIGHUP, sighup_handler);
     } else {
-        printf("\n  ┌─────────────────────────────────────┐\n");
-        printf("  │  Integer temp:   %4d °C             │\n", temp);
-        printf("  │  COUNT_REMAIN:   %4d                │\n", count_remain);
-        printf("  │  COUNT_PER_C:    %4d                │\n", count_per_c);
-        printf("  │  Hi-res temp:    %7.2f °C          │\n", hires);
-        printf("  │  Millidegrees:   %5d m°C           │\n", millideg);
-        printf("  └─────────────────────────────────────┘\n");
+        signal(SIGINT, sigterm_handler);
+        signal(SIGTERM, sigterm_handler);
+        signal(SIGHUP, sighup_handler);
+    }
 
-        if (status & DS1821_STATUS_THF)
-            printf("  *** HIGH alarm flag set!\n");
-        if (status & DS1821_STATUS_TLF)
-            printf("  *** LOW alarm flag set!\n");
-        if (tout >= 0)
-            printf("  TOUT (DQ/GPIO%d): %s\n", gpio_pin,
-                   tout ? "HIGH (active)" : "LOW (inactive)");
+    if (!quiet && !once)
+        printf("ds1821d: %d sensor(s) in %d power round(s), every %d s, publishing to %s/\n",
+               n_sensors, n_rounds, interval, run_dir);
+
+    int watching = watch_tout && !once;
+    if (!once)
+        ctl_listen();
+    long long start = mono_ns();
+    for (int i = 0; i < n_sensors; i++) {
+        struct sensor *s = &sensors[i];
+        s->tout_level = -1;
+        if (s->every_min == 0)
+            s->every_min = s->every_max = interval;
+        s->every = s->every_min;
+        s->due_ns = start;
     }
 
-    return 0;
-}
+    int errors = 0;
+    while (keep_running) {
+        schedule_due(mono_ns());
+        if (watching)
+            tout_watch(0);
+        errors = daemon_cycle();
+        if (once)
+            break;
+        if (watching)
+            tout_watch(1);
 
-/*
- * status action — machine-readable dump of everything:
- * temperature + thresholds + alarm flags + TOUT.
- * Always outputs key=value format regardless of --quiet.
- */
-static int action_status(void)
-{
-    /* Start conversion */
-    if (ds1821_start_convert() < 0)
-        return -1;
-    usleep(1000000);
+        /* Absolute deadline so read time doesn't add to the period */
+        long long wake = schedule_wake();
+        while (ctl_wait(wake))
+            ctl_serve(watching);
+    }
 
-    uint8_t status;
-    if (ds1821_read_status_reg(&status) < 0)
-        return -1;
+    if (watching)
+        tout_watch(0);
+    ctl_close();
+    if (errors && once)
+        fprintf(stderr, "ds1821d: %d sensor(s) failed\n", errors);
 
-    int8_t temp;
-    if (ds1821_read_temperature(&temp) < 0)
-        return -1;
+    return (once && errors) ? -1 : 0;
+}
 
-    uint8_t count_remain, count_per_c;
-    if (ds1821_read_counter(&count_remain) < 0)
-        return -1;
-    if (ds1821_read_slope(&count_per_c) < 0)
-        return -1;
+/* ── Provision action ────────────────────────────────────────────── */
 
-    int cpc = count_per_c ? count_per_c : 1;
-    int millideg = (int)temp * 1000 - 250 +
-                   ((int)(cpc - count_remain) * 1000) / cpc;
+/*
+ * Program the th= and tl= targets from sensors.conf into every sensor
+ * that has them.  A register that already holds its target is not
+ * written.  Writes are coalesced per power round: Write TH goes out on
+ * every pin that needs it, then one shared EEPROM wait polls NVB on all
+ * of them, then the same again for TL.  Sensors on different pins are
+ * programmed in parallel, and the wait ends when the slowest NVB clears.
+ */
 
-    int8_t th = 0, tl = 0;
-    int have_th = (ds1821_read_th(&th) == 0 && ds1821_read_tl(&tl) == 0);
-    int tout = read_tout();
+/* Shared EEPROM wait; pending[] marks the sensors that were written */
+static void eeprom_wait_batch(struct sensor *const *list, int n, const int *pending_in)
+{
+    long long start = now_us();
+    int pending[MAX_SENSORS], left = 0;
+
+    for (int i = 0; i < n; i++) {
+        pending[i] = pending_in[i];
+        left += pending[i];
+        if (pending[i]) {
+            select_sensor(list[i]);
+            ow->release();
+        }
+    }
+    if (!left)
+        return;
 
-    printf("temperature=%d\n", millideg);
-    printf("thf=%d\n", (status & DS1821_STATUS_THF) ? 1 : 0);
-    printf("tlf=%d\n", (status & DS1821_STATUS_TLF) ? 1 : 0);
-    if (have_th) {
-        printf("th=%d\n", th);
-        printf("tl=%d\n", tl);
+    bus_wait_us(EEPROM_WRITE_US);
+    while (left > 0) {
+        for (int i = 0; i < n; i++) {
+            uint8_t status;
+            if (!pending[i])
+                continue;
+            select_sensor(list[i]);
+            if (ds1821_read_reg(DS1821_CMD_READ_STATUS, &status) == 0 &&
+                !(status & DS1821_STATUS_NVB)) {
+                metrics_observe(STAGE_EEPROM, now_us() - start);
+                pending[i] = 0;
+                left--;
+            }
+        }
+        if (left == 0 || now_us() - start >= EEPROM_TIMEOUT_US)
+            break;
+        bus_wait_us(EEPROM_POLL_US);
     }
-    if (tout >= 0)
-        printf("tout=%d\n", tout);
 
-    return 0;
+    /* Timed out: the verify read afterwards decides */
+    for (int i = 0; i < n; i++) {
+        if (pending[i]) {
+            select_sensor(list[i]);
+            metrics_observe(STAGE_EEPROM, now_us() - start);
+        }
+    }
 }
 
-static int action_set_thresholds(int set_th, int set_tl, int8_t new_th, int8_t new_tl)
+/* Returns the number of sensors that failed; *written counts writes */
+static int provision_round(struct sensor *const *list, int n, int *written)
 {
-    printf("\n=== DS1821 Thermostat Thresholds ===\n\n");
+    int8_t cur[2][MAX_SENSORS];
+    int ok[MAX_SENSORS], wrote[2][MAX_SENSORS] = { { 0 } };
+    int errors = 0;
+
+    for (int k = 0; k < n; k++) {
+        select_sensor(list[k]);
+        ok[k] = (list[k]->want_th != NO_TARGET || list[k]->want_tl != NO_TARGET) &&
+                ds1821_read_th(&cur[0][k]) == 0 && ds1821_read_tl(&cur[1][k]) == 0;
+    }
 
-    /* Read current values */
-    int8_t cur_th, cur_tl;
-    if (ds1821_read_th(&cur_th) < 0 || ds1821_read_tl(&cur_tl) < 0)
-        return -1;
+    for (int reg = 0; reg < 2; reg++) {
+        for (int k = 0; k < n; k++) {
+            int want = reg ? list[k]->want_tl : list[k]->want_th;
+            if (!ok[k] || want == NO_TARGET || want == cur[reg][k])
+                continue;
+            select_sensor(list[k]);
+            wrote[reg][k] = (ds1821_write_thresh(reg ? DS1821_CMD_WRITE_TL :
+                                                 DS1821_CMD_WRITE_TH, want) == 0);
+            ok[k] = wrote[reg][k];
+            *written += wrote[reg][k];
+        }
+        eeprom_wait_batch(list, n, wrote[reg]);
+    }
 
-    printf("  Current: TH=%d°C  TL=%d°C\n", cur_th, cur_tl);
+    for (int k = 0; k < n; k++) {
+        struct sensor *s = list[k];
+        int8_t th, tl;
 
-    if (set_th) {
-        printf("  Writing TH=%d°C...\n", new_th);
-        if (ds1821_write_th(new_th) < 0)
-            return -1;
-    }
-    if (set_tl) {
-        printf("  Writing TL=%d°C...\n", new_tl);
-        if (ds1821_write_tl(new_tl) < 0)
-            return -1;
+        if (s->want_th == NO_TARGET && s->want_tl == NO_TARGET)
+            continue;
+        select_sensor(s);
+        s->cache.valid = 0;
+        if (ok[k] && (wrote[0][k] || wrote[1][k]) &&
+            (ds1821_read_th(&th) < 0 || ds1821_read_tl(&tl) < 0 ||
+             (s->want_th != NO_TARGET && th != s->want_th) ||
+             (s->want_tl != NO_TARGET && tl != s->want_tl)))
+            ok[k] = 0;
+
+        if (!ok[k]) {
+            fprintf(stderr, "provision: failed to program '%s'\n", s->name);
+            errors++;
+        } else if (!quiet) {
+            printf("  %-16s TH %4d%s  TL %4d%s\n", s->name,
+                   wrote[0][k] ? s->want_th : cur[0][k], wrote[0][k] ? " (written)" : "",
+                   wrote[1][k] ? s->want_tl : cur[1][k], wrote[1][k] ? " (written)" : "");
+        }
     }
+    return errors;
+}
 
-    /* Verify */
-    if (ds1821_read_th(&cur_th) < 0 || ds1821_read_tl(&cur_tl) < 0)
-        return -1;
+static int action_provision(void)
+{
+    int errors = 0, written = 0;
 
-    printf("  Verified: TH=%d°C  TL=%d°C\n", cur_th, cur_tl);
+    sensors_power_up();
+    for (int round = 0; round < n_rounds; round++) {
+        struct sensor *list[MAX_SENSORS];
+        int idx[MAX_SENSORS];
+        int n = round_begin(round, list, idx);
 
-    if (cur_tl >= cur_th)
-        printf("  Warning: TL >= TH — thermostat will not operate correctly.\n");
+        errors += provision_round(list, n, &written);
+        round_end(list, n);
+    }
 
-    return 0;
+    if (!quiet)
+        printf("provision: %d register(s) written, %d sensor(s) failed\n",
+               written, errors);
+    return errors ? -1 : 0;
 }
 
-static int action_set_oneshot(void)
-{
-    printf("\n=== Setting DS1821(s) to 1-Wire / One-Shot mode ===\n\n");
+/* ── Library API (libds1821) ─────────────────────────────────────── */
 
-    /* Read current status */
-    uint8_t status;
-    if (ds1821_read_status_reg(&status) < 0)
+/*
+ * The public entry points declared in ds1821.h.  A handle is a struct
+ * sensor, so the library reads through the same read_batch(), retry and
+ * TH/TL cache paths as the daemon.  Built with -DDS1821_LIB, this file
+ * has no main() and becomes libds1821.so.
+ */
+struct ds1821 {
+    struct sensor s;
+    struct ow_metrics m;
+    long long convert_at; /* when Start Convert went out, 0 = none */
+    long done_us;       /* conversion time, once DONE was seen */
+    int  done_status;   /* status byte that showed DONE, -1 = not seen */
+};
+
+int ds1821_init(const char *engine, int flags)
+{
+    ow = engine ? find_engine(engine) : &ow_engines[0];
+    if (!ow) {
+        fprintf(stderr, "Unknown engine: %s (bitbang, wave, netlink, sysfs, sim)\n", engine);
+        ow = &ow_engines[0];
         return -1;
+    }
+    poll_done = !!(flags & DS1821_INIT_POLL_DONE);
+    verbose = !!(flags & DS1821_INIT_VERBOSE);
+    quiet = 1;
+
+    use_pigpio = ow->needs_pigpio;
+    if (use_pigpio) {
+        /* Queue behind the CLI and daemon, like they do for each other */
+        bus_lock_add("pigpio");
+        if (bus_lock() < 0)
+            return -1;
+        if (gpioInitialise() < 0) {
+            fprintf(stderr, "Failed to initialize pigpio!\n");
+            bus_unlock();
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    printf("  Current status (direct, ANDed if multiple devices):\n");
-    print_status(status);
-
-    /*
-     * Write status: 1SHOT=1, POL=0, clear alarm flags.
-     * We try MULTIPLE methods since these devices may be in different states:
-     *   1. Direct write (thermostat mode — no ROM command)
-     *   2. Skip ROM + write (proper 1-Wire addressing)
-     *   3. Repeat both for good measure
-     */
-    uint8_t new_status = DS1821_STATUS_1SHOT;  /* 0x01 */
+void ds1821_exit(void)
+{
+    if (use_pigpio)
+        gpioTerminate();
+    use_pigpio = 0;
+    bus_unlock();
+}
 
-    printf("\n  === Attempt 1: Direct write (no ROM) ===\n");
-    printf("  Writing status: 0x%02X\n", new_status);
-    if (ds1821_write_status_reg(new_status) < 0)
-        return -1;
+struct ds1821 *ds1821_open(const struct ds1821_config *cfg)
+{
+    const struct ow_timing *timing = find_timing(cfg->timing ? cfg->timing : "standard");
 
-    /* Verify */
-    if (ds1821_read_status_reg(&status) == 0) {
-        printf("  Read back: 0x%02X  1SHOT=%d POL=%d\n",
-               status, !!(status & DS1821_STATUS_1SHOT), !!(status & 0x02));
+    if (!timing || cfg->retries < 0) {
+        fprintf(stderr, "ds1821_open: bad timing or retries\n");
+        return NULL;
     }
-
-    printf("\n  === Attempt 2: Skip ROM + write ===\n");
-    printf("  Writing status: 0x%02X\n", new_status);
-    if (ds1821_write_status_skiprom(new_status) < 0)
-        return -1;
-
-    /* Verify via skip ROM too */
-    if (ds1821_read_status_skiprom(&status) == 0) {
-        printf("  Read back (skip ROM): 0x%02X  1SHOT=%d POL=%d\n",
-               status, !!(status & DS1821_STATUS_1SHOT), !!(status & 0x02));
+    if (!use_pigpio && !ow->simulated && (cfg->power_pin >= 0 || cfg->read_tout)) {
+        fprintf(stderr, "ds1821_open: power and TOUT pins need a GPIO engine\n");
+        return NULL;
     }
 
-    printf("\n  === Attempt 3: Direct write again ===\n");
-    if (ds1821_write_status_reg(new_status) < 0)
-        return -1;
-
-    /* Final verification */
-    printf("\n  Final readback:\n");
-    if (ds1821_read_status_reg(&status) == 0) {
-        print_status(status);
-    }
-    if (ds1821_read_status_skiprom(&status) == 0) {
-        printf("  Via Skip ROM: 0x%02X\n", status);
+    struct ds1821 *d = calloc(1, sizeof(*d));
+    if (!d)
+        return NULL;
+
+    snprintf(d->s.name, sizeof(d->s.name), "GPIO%d", cfg->data_pin);
+    d->s.data_pin  = cfg->data_pin;
+    d->s.power_pin = cfg->power_pin;
+    d->s.read_tout = cfg->read_tout;
+    d->s.tx_pin    = cfg->tx_pin;
+    d->s.w1_master = cfg->w1_master;
+    if (cfg->w1_device)
+        snprintf(d->s.w1_device, sizeof(d->s.w1_device), "%s", cfg->w1_device);
+    d->s.timing    = timing;
+    d->s.retries   = cfg->retries;
+    d->s.metrics   = &d->m;
+    d->s.off_ms    = power_off_ms;
+
+    select_sensor(&d->s);
+    ow->release();
+    if (power_pin >= 0) {
+        set_sensor_power(&d->s, 1);
+        ds1821_power_up_wait();
     }
+    sensor_self_test(&d->s);
+    return d;
+}
 
-    printf("\n  Note: With 3 devices on the bus, status reads are ANDed.\n");
-    printf("  If ANY device has 1SHOT=0, the combined read shows 0.\n");
-    printf("  The write goes to ALL devices simultaneously, so all should\n");
-    printf("  be programmed. A power cycle may be needed for the change\n");
-    printf("  to take effect.\n");
+void ds1821_close(struct ds1821 *d)
+{
+    free(d);
+}
 
+int ds1821_start_conversion(struct ds1821 *d)
+{
+    select_sensor(&d->s);
+    ow->release();
+    d->convert_at = 0;
+    if (ds1821_start_convert() < 0)
+        return -1;
+    d->convert_at = now_us();
+    d->done_status = -1;
     return 0;
 }
 
-
-/*
- * Power-cycle DS1821s via a GPIO pin driving their VDD.
- * Requires pigpio to be initialised.
- */
-static int power_cycle_ds1821(void)
+int ds1821_poll(struct ds1821 *d)
 {
-    if (power_pin < 0) {
-        if (!quiet)
-            printf("\nNo --power-gpio set — cannot power-cycle.\n"
-                   "  Please disconnect and reconnect DS1821 VDD manually.\n");
+    if (!d->convert_at)
         return -1;
-    }
-
-    if (!quiet)
-        printf("\nPower-cycling DS1821s via GPIO%d...\n", power_pin);
+    if (d->done_us)
+        return 1;
 
-    /* Drive power pin LOW to cut VDD */
-    gpioSetMode(power_pin, PI_OUTPUT);
-    gpioWrite(power_pin, 0);
+    long long elapsed = now_us() - d->convert_at;
+    if (elapsed < CONVERT_POLL_FIRST_US)
+        return 0;
 
-    if (!quiet)
-        printf("  VDD OFF — waiting 500ms for capacitors to drain...\n");
-    usleep(500000);  /* 500ms off */
+    uint8_t status;
+    select_sensor(&d->s);
+    if (elapsed < CONVERT_TIMEOUT_US &&
+        !(ds1821_read_status_reg(&status) == 0 && (status & DS1821_STATUS_DONE)))
+        return 0;
+
+    if (elapsed < CONVERT_TIMEOUT_US)
+        d->done_status = status;
+    d->done_us = now_us() - d->convert_at;
+    metrics_observe(STAGE_CONVERT, d->done_us);
+    return 1;
+}
 
-    /* Drive power pin HIGH to restore VDD */
-    gpioWrite(power_pin, 1);
+int ds1821_fetch(struct ds1821 *d, struct ds1821_reading *out)
+{
+    int done = ds1821_poll(d);
+    if (done <= 0) {
+        errno = done == 0 ? EAGAIN : EINVAL;
+        return -1;
+    }
 
-    if (!quiet)
-        printf("  VDD ON — waiting 500ms for DS1821s to boot...\n");
-    usleep(500000);  /* 500ms for POR */
+    int known = d->done_status >= 0;
+    if (known)
+        out->status = (uint8_t)d->done_status;
+
+    select_sensor(&d->s);
+    int ret = ds1821_collect(out, &d->s.cache, known);
+    out->conv_us = d->done_us;
+    d->s.timing = tm;
+    d->convert_at = d->done_us = 0;
+    if (ret < 0)
+        metrics->read_errors++;
+    else
+        metrics->readings++;
+    return ret;
+}
 
-    if (!quiet)
-        printf("  Power cycle complete.\n");
+int ds1821_read_batch(struct ds1821 *const *devs, int n,
+                      struct ds1821_reading *out, int *ok)
+{
+    struct sensor *list[MAX_SENSORS] = { NULL };
 
-    return 0;
+    if (n < 1 || n > MAX_SENSORS)
+        return -1;
+    for (int i = 0; i < n; i++)
+        list[i] = &devs[i]->s;
+
+    int errors = read_batch(list, n, out, ok);
+    for (int i = 0; i < n; i++)
+        if (ok[i])
+            devs[i]->m.readings++;
+    return errors;
 }
 
-/*
- * Ensure the power pin stays HIGH after pigpio terminates.
- * pigpio resets all pins on gpioTerminate(), so we use pinctrl
- * to re-assert the output state.
- */
-static void persist_power_pin(void)
+int ds1821_read(struct ds1821 *d, struct ds1821_reading *out)
 {
-    if (power_pin < 0)
-        return;
+    int ok;
+    return ds1821_read_batch(&d, 1, out, &ok) == 0 ? 0 : -1;
+}
 
-    char cmd[128];
-    snprintf(cmd, sizeof(cmd),
-             "pinctrl set %d op dh 2>/dev/null", power_pin);
-    if (system(cmd) != 0) {
-        /* Fallback: try raspi-gpio */
-        snprintf(cmd, sizeof(cmd),
-                 "raspi-gpio set %d op dh 2>/dev/null", power_pin);
-        system(cmd);
+int ds1821_set_thresholds(struct ds1821 *d, int th, int tl)
+{
+    if (th < -55 || th > 125 || tl < -55 || tl > 125) {
+        fprintf(stderr, "ds1821_set_thresholds: out of range (-55 to 125)\n");
+        return -1;
     }
+
+    select_sensor(&d->s);
+    d->s.cache.valid = 0;
+    if (ds1821_write_th((int8_t)th) < 0 || ds1821_write_tl((int8_t)tl) < 0)
+        return -1;
+    return 0;
 }
 
+#ifndef DS1821_LIB
+
 /* ── Usage ───────────────────────────────────────────────────────── */
 
 static void usage(const char *prog)
@@ -942,11 +5661,58 @@ static void usage(const char *prog)
            "  set-th N     Set high-alarm threshold to N °C (-55 to 125)\n"
            "  set-tl N     Set low-alarm threshold to N °C (-55 to 125)\n"
            "  set-oneshot  Write status register to enable 1-Wire mode\n"
-           "  fix          Full sequence: set-oneshot + power-cycle\n\n"
+           "  fix          Full sequence: set-oneshot + power-cycle\n"
+           "  daemon       Read all sensors in the config file every interval\n"
+           "  profile      Measure real bit-bang slot widths against the datasheet\n"
+           "  bench        Time --reads full readings per stage, JSON on stdout\n"
+           "  provision    Program th=/tl= from the config file into every sensor\n"
+           "  history [NAME]  Print logged readings, one sensor or all of them\n\n"
            "Options:\n"
            "  --gpio N        Use GPIO pin N for 1-Wire data (default: %d)\n"
            "  --power-gpio N  GPIO pin powering DS1821 VDD (enables auto power-cycle)\n"
+           "  --off-ms N      VDD off time when power-cycling (default: 500)\n"
            "  --read-tout     Read thermostat output state from DQ pin\n"
+           "  --watch-tout    Daemon: publish TOUT edges between cycles as they happen\n"
+           "  --engine NAME   1-Wire engine: bitbang (default), wave (DMA-timed),\n"
+           "                  netlink (kernel w1 master, no pigpio), sysfs (kernel\n"
+           "                  w1 slave rw file, needs --w1-device) or sim\n"
+           "                  (simulated DS1821s, virtual time, no root)\n"
+           "  --timing NAME   Bit-bang slot timing: standard (default), tight or long\n"
+           "  --retries N     Extra reads per register until two agree (default: 2,\n"
+           "                  0 = single-shot)\n"
+           "  --rt-cpu N      Run bus transactions on a thread pinned to CPU N,\n"
+           "                  at SCHED_FIFO only from reset to last bit\n"
+           "  --rt-prio N     SCHED_FIFO priority for --rt-cpu (default: 50)\n"
+           "  --tx-gpio N     Wave engine: GPIO driving DQ low via open-drain/diode\n"
+           "  --w1-master N   Netlink engine: kernel w1_bus_masterN (default: 1)\n"
+           "  --w1-device ID  Sysfs engine: 1-Wire mode slave, e.g. 22-0000012345\n"
+           "  --poll-done     End conversion wait as soon as DONE is set\n"
+           "  --rescan        scan: ignore cached ROMs, run a full Search ROM\n"
+           "  --cache-dir DIR scan: ROM cache directory (default: %s)\n"
+           "  --config FILE   Sensor list for daemon (default: %s)\n"
+           "  --interval N    Daemon poll interval in seconds (default: %d)\n"
+           "  --once          Daemon: run one cycle and exit\n"
+           "  --run-dir DIR   Output directory for daemon/--publish (default: %s)\n"
+           "  --publish NAME  status: also write <run-dir>/NAME/ files atomically\n"
+           "  --metrics FILE  Daemon: write Prometheus textfile metrics each cycle\n"
+           "  --push URL      Daemon: send each cycle as JSON to udp://host:port or\n"
+           "                  mqtt://host[:port][/topic] (QoS 1)\n"
+           "  --history-dir DIR  Daemon: log readings to DIR/<name>.hist;\n"
+           "                  history reads DIR (default: %s)\n"
+           "  --from T, --to T   history: time range, Unix seconds or -N[smhd]\n"
+           "                  before now (default: -1d to now)\n"
+           "  --cache-refresh N  Daemon: re-read cached TH/TL every N s (default: 600,\n"
+           "                  0 = read every cycle; SIGHUP forces a re-read)\n"
+           "  --slots N       profile: slots measured per type (default: 2000)\n"
+           "  --reads N       bench: readings to time (default: 100)\n"
+           "  --sensor NAME   probe/temp/status/set-th/set-tl via ds1821d: pick the\n"
+           "                  sensor by name instead of by --gpio\n"
+           "  --lock-wait N   Wait up to N s for another ds1821 on the same GPIO\n"
+           "                  (default: 30)\n"
+           "  --sim-temp C[:SWING[:PERIOD]]  Sim engine: temperature, optionally\n"
+           "                  swinging ±SWING °C over PERIOD s (default: 21.5)\n"
+           "  --sim-state FILE  Sim engine: keep TH/TL/config between runs\n"
+           "  --sim-flip N    Sim engine: corrupt about one read slot in N\n"
            "  --quick, -q     Minimal output (just temperature value)\n"
            "  --verbose       Show low-level 1-Wire traffic\n"
            "  --help          Show this help\n\n"
@@ -954,7 +5720,74 @@ static void usage(const char *prog)
            "  sudo %s probe          # Verify communication\n"
            "  sudo %s temp           # Read temperature\n"
            "  sudo %s fix            # Switch to 1-Wire mode & reload\n",
-           prog, DEFAULT_GPIO_PIN, prog, prog, prog);
+           prog, DEFAULT_GPIO_PIN, DEFAULT_CACHE_DIR, DEFAULT_CONFIG,
+           DEFAULT_INTERVAL, DEFAULT_RUN_DIR, DEFAULT_HISTORY_DIR, prog, prog, prog);
+}
+
+/* ── Action dispatch ─────────────────────────────────────────────── */
+
+struct action_req {
+    const char *action;
+    int8_t th, tl;
+    int has_th, has_tl;
+    int interval, once;
+    int ret;            /* bus thread result */
+};
+
+static int run_action(const struct action_req *a)
+{
+    const char *action = a->action;
+    int do_fix = (strcmp(action, "fix") == 0);
+    int do_daemon = (strcmp(action, "daemon") == 0);
+    int do_profile = (strcmp(action, "profile") == 0);
+    int do_provision = (strcmp(action, "provision") == 0);
+
+    /* A trimmed --timing profile must prove itself on this line first */
+    if (!do_daemon && !do_profile && !do_provision)
+        timing_self_test();
+
+    int ret = 0;
+
+    if (strcmp(action, "scan") == 0) {
+        ret = action_scan();
+    } else if (strcmp(action, "probe") == 0) {
+        ret = action_probe();
+    } else if (strcmp(action, "status") == 0) {
+        ret = action_status();
+    } else if (strcmp(action, "temp") == 0) {
+        ret = action_read_temp();
+    } else if (do_daemon) {
+        ret = action_daemon(a->interval, a->once);
+    } else if (do_provision) {
+        ret = action_provision();
+    } else if (do_profile) {
+        ret = action_profile();
+    } else if (strcmp(action, "bench") == 0) {
+        ret = action_bench();
+    } else if (a->has_th || a->has_tl) {
+        ret = action_set_thresholds(a->has_th, a->has_tl, a->th, a->tl);
+    } else if (strcmp(action, "set-oneshot") == 0 || do_fix) {
+        ret = action_probe();
+        if (ret == 0) {
+            ret = action_set_oneshot();
+        }
+        if (do_fix && ret == 0) {
+            ret = power_cycle_ds1821();
+        }
+    } else {
+        fprintf(stderr, "Unknown action: %s\n", action);
+        ret = 1;
+    }
+
+    return ret;
+}
+
+/* --rt-cpu: run the whole action on the pinned bus thread */
+static void *bus_thread(void *arg)
+{
+    struct action_req *a = arg;
+    a->ret = rt_setup() < 0 ? -1 : run_action(a);
+    return NULL;
 }
 
 /* ── main ────────────────────────────────────────────────────────── */
@@ -964,15 +5797,111 @@ int main(int argc, char *argv[])
     const char *action = NULL;
     int8_t arg_th = 0, arg_tl = 0;
     int has_th = 0, has_tl = 0;
+    const char *config_path = DEFAULT_CONFIG;
+    int interval = DEFAULT_INTERVAL;
+    int once = 0;
+    const char *history_name = NULL;
+
+    /* Invoked as ds1821d: daemon is the default action */
+    const char *base = strrchr(argv[0], '/');
+    base = base ? base + 1 : argv[0];
+    if (strcmp(base, "ds1821d") == 0)
+        action = "daemon";
 
     /* Parse args */
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--gpio") == 0 && i + 1 < argc) {
             gpio_pin = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            ow = find_engine(argv[++i]);
+            ctl_given |= CTL_ENGINE;
+            if (!ow) {
+                fprintf(stderr, "Unknown engine: %s (bitbang, wave, netlink, sysfs, sim)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            tm = find_timing(argv[++i]);
+            ctl_given |= CTL_TIMING;
+            if (!tm) {
+                fprintf(stderr, "Unknown timing: %s (standard, tight, long)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            read_retries = atoi(argv[++i]);
+            if (read_retries < 0) read_retries = 0;
+            ctl_given |= CTL_RETRIES;
+        } else if (strcmp(argv[i], "--cache-refresh") == 0 && i + 1 < argc) {
+            cache_refresh_s = atoi(argv[++i]);
+            if (cache_refresh_s < 0) cache_refresh_s = 0;
+        } else if (strcmp(argv[i], "--rt-cpu") == 0 && i + 1 < argc) {
+            rt_cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rt-prio") == 0 && i + 1 < argc) {
+            rt_prio = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tx-gpio") == 0 && i + 1 < argc) {
+            tx_pin = atoi(argv[++i]);
+            ctl_given |= CTL_TX;
+        } else if (strcmp(argv[i], "--w1-master") == 0 && i + 1 < argc) {
+            w1_master = atoi(argv[++i]);
+            ctl_given |= CTL_W1M;
+        } else if (strcmp(argv[i], "--w1-device") == 0 && i + 1 < argc) {
+            w1_device = argv[++i];
+            ctl_given |= CTL_W1DEV;
         } else if (strcmp(argv[i], "--power-gpio") == 0 && i + 1 < argc) {
             power_pin = atoi(argv[++i]);
+            ctl_given |= CTL_POWER;
+        } else if (strcmp(argv[i], "--off-ms") == 0 && i + 1 < argc) {
+            power_off_ms = atoi(argv[++i]);
+            if (power_off_ms < 0) power_off_ms = 0;
         } else if (strcmp(argv[i], "--read-tout") == 0) {
             read_tout_flag = 1;
+        } else if (strcmp(argv[i], "--watch-tout") == 0) {
+            watch_tout = 1;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            config_path = argv[++i];
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = atoi(argv[++i]);
+            if (interval < 1) interval = 1;
+        } else if (strcmp(argv[i], "--once") == 0) {
+            once = 1;
+        } else if (strcmp(argv[i], "--poll-done") == 0) {
+            poll_done = 1;
+        } else if (strcmp(argv[i], "--rescan") == 0) {
+            force_rescan = 1;
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--run-dir") == 0 && i + 1 < argc) {
+            run_dir = argv[++i];
+        } else if (strcmp(argv[i], "--publish") == 0 && i + 1 < argc) {
+            publish_name = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (strcmp(argv[i], "--lock-wait") == 0 && i + 1 < argc) {
+            lock_wait_s = atoi(argv[++i]);
+            if (lock_wait_s < 0) lock_wait_s = 0;
+        } else if (strcmp(argv[i], "--sensor") == 0 && i + 1 < argc) {
+            ctl_sensor = argv[++i];
+        } else if (strcmp(argv[i], "--push") == 0 && i + 1 < argc) {
+            push_url = argv[++i];
+        } else if (strcmp(argv[i], "--history-dir") == 0 && i + 1 < argc) {
+            history_dir = argv[++i];
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            hist_from = argv[++i];
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            hist_to = argv[++i];
+        } else if (strcmp(argv[i], "--sim-temp") == 0 && i + 1 < argc) {
+            if (parse_sim_temp(argv[++i]) < 0)
+                return 1;
+        } else if (strcmp(argv[i], "--sim-state") == 0 && i + 1 < argc) {
+            sim_state_path = argv[++i];
+        } else if (strcmp(argv[i], "--sim-flip") == 0 && i + 1 < argc) {
+            sim_flip = atoi(argv[++i]);
+            if (sim_flip < 0) sim_flip = 0;
+        } else if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            profile_slots = atoi(argv[++i]);
+            if (profile_slots < PROFILE_BURST) profile_slots = PROFILE_BURST;
+        } else if (strcmp(argv[i], "--reads") == 0 && i + 1 < argc) {
+            bench_reads = atoi(argv[++i]);
+            if (bench_reads < 1) bench_reads = 1;
         } else if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) {
             verbose = 1;
         } else if (strcmp(argv[i], "--quick") == 0 || strcmp(argv[i], "-q") == 0) {
@@ -988,6 +5917,10 @@ int main(int argc, char *argv[])
             action = "set-tl";
             arg_tl = (int8_t)atoi(argv[++i]);
             has_tl = 1;
+        } else if (strcmp(argv[i], "history") == 0) {
+            action = "history";
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                history_name = argv[++i];
         } else if (argv[i][0] != '-') {
             action = argv[i];
         } else {
@@ -1002,76 +5935,144 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if (geteuid() != 0) {
-        fprintf(stderr, "This tool must be run as root (sudo).\n");
-        return 1;
-    }
+    /* ds1821d's stdout may be a control socket client: keep it in order with stderr */
+    if (strcmp(action, "daemon") == 0)
+        setvbuf(stdout, NULL, _IOLBF, 0);
+
+    /* history only reads files: no pigpio, no root */
+    if (strcmp(action, "history") == 0)
+        return action_history(history_name) < 0 ? 1 : 0;
 
-    int do_fix = (strcmp(action, "fix") == 0);
-    int do_temp = (strcmp(action, "temp") == 0);
     int do_status = (strcmp(action, "status") == 0);
+    int do_daemon = (strcmp(action, "daemon") == 0);
+    int do_profile = (strcmp(action, "profile") == 0);
+    int do_provision = (strcmp(action, "provision") == 0);
 
-    /* status is inherently machine-readable — suppress banner */
-    if (do_status)
+    /* status and bench are inherently machine-readable — suppress banner */
+    if (do_status || strcmp(action, "bench") == 0)
         quiet = 1;
 
-    if (!quiet) {
+    if (do_daemon || do_provision) {
+        if (load_config(config_path) < 0)
+            return 1;
+        if (n_sensors == 0) {
+            fprintf(stderr, "No sensors defined in %s\n", config_path);
+            return 1;
+        }
+        if (plan_power_rounds() < 0)
+            return 1;
+    }
+    if (do_daemon && push_url && push_parse_url(push_url) < 0)
+        return 1;
+
+    /* pigpio is only needed for GPIO engines and for power/TOUT pins */
+    use_pigpio = ow->needs_pigpio || (power_pin >= 0 && !ow->simulated);
+    for (int i = 0; i < n_sensors; i++)
+        if (sensors[i].power_pin >= 0 && !ow->simulated)
+            use_pigpio = 1;
+
+    if (!ow->needs_pigpio && (watch_tout || (read_tout_flag && !ow->simulated))) {
+        fprintf(stderr, "--read-tout and --watch-tout need a GPIO engine (DQ is owned by the w1 master)\n");
+        return 1;
+    }
+
+    if (do_profile && ow != &ow_engines[0]) {
+        fprintf(stderr, "profile measures the bitbang engine only\n");
+        return 1;
+    }
+
+    /* With ds1821d running, interactive actions queue behind its cycles */
+    if (has_th || has_tl || strcmp(action, "probe") == 0 ||
+        strcmp(action, "temp") == 0 || (do_status && !publish_name)) {
+        int rc = ctl_forward(action, has_th, arg_th, has_tl, arg_tl);
+        if (rc >= 0)
+            return rc;
+    }
+
+    if (use_pigpio && geteuid() != 0) {
+        fprintf(stderr, "This tool must be run as root (sudo).\n");
+        return 1;
+    }
+
+    /* Wait for any other ds1821 on the same buses: the config's, or the CLI's */
+    if (do_daemon || do_provision)
+        for (int i = 0; i < n_sensors; i++) {
+            const struct sensor *s = &sensors[i];
+            bus_lock_add_bus(s->data_pin, s->power_pin, s->tx_pin, s->w1_master,
+                             s->w1_device[0] ? s->w1_device : NULL);
+        }
+    else
+        bus_lock_add_bus(gpio_pin, power_pin, tx_pin, w1_master, w1_device);
+    if (bus_lock() < 0)
+        return 1;
+
+    if (!quiet && !do_daemon && !do_provision) {
         printf("DS1821 Direct Programmer — GPIO%d\n", gpio_pin);
         printf("──────────────────────────────────\n");
     }
 
+    /* profile timestamps edges: sample DQ every 1 µs instead of 5 µs */
+    if (do_profile)
+        gpioCfgClock(1, PI_CLOCK_PCM, 0);
+
     /* Initialize pigpio */
-    if (gpioInitialise() < 0) {
+    if (use_pigpio && gpioInitialise() < 0) {
         fprintf(stderr, "Failed to initialize pigpio!\n");
         fprintf(stderr, "Make sure pigpiod is NOT running: sudo systemctl stop pigpiod\n");
         return 1;
     }
 
     /* If power pin is set, make sure it's driving HIGH (VDD on) */
-    if (power_pin >= 0) {
-        gpioSetMode(power_pin, PI_OUTPUT);
-        gpioWrite(power_pin, 1);
-    }
+    if (power_pin >= 0)
+        bus_power(power_pin, 1);
 
     /* Set pin to input with pullup (idle state for 1-Wire) */
-    ow_release();
+    ow->release();
 
     /* Wait for DS1821s to power up and bus to settle */
     if (power_pin >= 0)
-        usleep(500000);  /* 500ms for DS1821 power-on reset */
+        ds1821_power_up_wait();
     else
-        gpioDelay(1000);
-
-    int ret = 0;
-
-    if (strcmp(action, "scan") == 0) {
-        ret = action_scan();
-    } else if (strcmp(action, "probe") == 0) {
-        ret = action_probe();
-    } else if (do_status) {
-        ret = action_status();
-    } else if (do_temp) {
-        ret = action_read_temp();
-    } else if (has_th || has_tl) {
-        ret = action_set_thresholds(has_th, has_tl, arg_th, arg_tl);
-    } else if (strcmp(action, "set-oneshot") == 0 || do_fix) {
-        ret = action_probe();
-        if (ret == 0) {
-            ret = action_set_oneshot();
-        }
-        if (do_fix && ret == 0) {
-            ret = power_cycle_ds1821();
+        bus_wait_us(1000);
+
+    struct action_req req = {
+        .action = action, .th = arg_th, .tl = arg_tl,
+        .has_th = has_th, .has_tl = has_tl, .interval = interval, .once = once,
+    };
+    int ret;
+
+    /* Started here, not on the pinned bus thread, so it isn't pinned */
+    if (do_daemon && push_url && push_start() < 0)
+        ret = -1;
+    else if (rt_cpu >= 0) {
+        pthread_t bus;
+        if (pthread_create(&bus, NULL, bus_thread, &req) != 0) {
+            fprintf(stderr, "Cannot start bus thread\n");
+            ret = -1;
+        } else {
+            pthread_join(bus, NULL);
+            ret = req.ret;
         }
     } else {
-        fprintf(stderr, "Unknown action: %s\n", action);
-        ret = 1;
+        ret = run_action(&req);
+    }
+    push_finish();
+
+    if (use_pigpio) {
+        /* Clean up pigpio */
+        gpioTerminate();
+
+        /* Keep power pin HIGH after pigpio releases GPIO */
+        persist_power_pin();
+        for (int i = 0; i < n_sensors; i++) {
+            if (sensors[i].gated)
+                continue;   /* never leave a shared pin's sensors all on */
+            select_sensor(&sensors[i]);
+            persist_power_pin();
+        }
     }
-
-    /* Clean up pigpio */
-    gpioTerminate();
-
-    /* Keep power pin HIGH after pigpio releases GPIO */
-    persist_power_pin();
 
     return ret < 0 ? 1 : 0;
 }
+
+#endif /* !DS1821_LIB */
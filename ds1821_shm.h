@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * ds1821_shm.h — shared-memory ring of recent DS1821 readings
+ *
+ * The daemon keeps /run/ds1821/<name>/ring mapped and appends one slot
+ * per reading.  Each slot is protected by its own sequence counter
+ * (odd while being written), so a reader never blocks the writer and
+ * never sees a torn slot.  Once a ring is mapped, reading it costs no
+ * system calls.
+ *
+ * Header-only.  Reader usage:
+ *
+ *     const struct ds1821_shm *ring = ds1821_shm_open("/run/ds1821/indoor/ring");
+ *     struct ds1821_shm_sample s;
+ *     if (ring && ds1821_shm_latest(ring, &s) == 0)
+ *         printf("%d m°C\n", s.millideg);
+ *
+ * The layout is fixed by DS1821_SHM_VERSION. A reader refuses to use a
+ * file whose magic, version or slot size does not match.
+ */
+#ifndef DS1821_SHM_H
+#define DS1821_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DS1821_SHM_MAGIC    0x31323831u   /* "1821" little-endian */
+#define DS1821_SHM_VERSION  1
+#define DS1821_SHM_SLOTS    256           /* about 4 h at a 60 s interval */
+#define DS1821_SHM_RETRIES  16            /* reader attempts per slot */
+
+/* The value part of one reading, as copied out to a reader */
+struct ds1821_shm_sample {
+    uint64_t num;           /* reading number since the ring was created */
+    int64_t  time_ns;       /* CLOCK_REALTIME when published */
+    int32_t  millideg;      /* same value as the temperature file */
+    int8_t   temp;          /* raw Read Temperature (°C) */
+    uint8_t  count_remain;  /* raw Read Counter */
+    uint8_t  count_per_c;   /* raw Read Slope */
+    uint8_t  status;        /* status register */
+};
+
+struct ds1821_shm_slot {
+    uint32_t seq;           /* odd while the writer is inside the slot */
+    uint32_t pad;
+    struct ds1821_shm_sample s;
+};
+
+struct ds1821_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t slot_size;
+    uint64_t head;          /* readings written; newest is head - 1 */
+    struct ds1821_shm_slot slot[DS1821_SHM_SLOTS];
+};
+
+/* ── Reader ──────────────────────────────────────────────────────── */
+
+/*
+ * Map a ring read-only.  Returns NULL if it is missing or not a ring,
+ * including one still being created (too short to map without SIGBUS).
+ */
+static inline const struct ds1821_shm *ds1821_shm_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct ds1821_shm)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, sizeof(struct ds1821_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    const struct ds1821_shm *shm = p;
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != DS1821_SHM_MAGIC ||
+        shm->version != DS1821_SHM_VERSION || shm->nslots != DS1821_SHM_SLOTS ||
+        shm->slot_size != sizeof(struct ds1821_shm_slot)) {
+        munmap(p, sizeof(struct ds1821_shm));
+        return NULL;
+    }
+    return shm;
+}
+
+static inline void ds1821_shm_close(const struct ds1821_shm *shm)
+{
+    if (shm)
+        munmap((void *)shm, sizeof(struct ds1821_shm));
+}
+
+/*
+ * Copy reading number num out of the ring.  Returns 0 on success, -1 if
+ * it has been overwritten (or not written yet), or if the writer kept
+ * the slot busy for every retry.
+ */
+static inline int ds1821_shm_read(const struct ds1821_shm *shm, uint64_t num,
+                                  struct ds1821_shm_sample *out)
+{
+    const struct ds1821_shm_slot *sl = &shm->slot[num % DS1821_SHM_SLOTS];
+
+    for (int i = 0; i < DS1821_SHM_RETRIES; i++) {
+        uint32_t s1 = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1)
+            continue;
+        struct ds1821_shm_sample tmp;
+        tmp.num          = __atomic_load_n(&sl->s.num, __ATOMIC_RELAXED);
+        tmp.time_ns      = __atomic_load_n(&sl->s.time_ns, __ATOMIC_RELAXED);
+        tmp.millideg     = __atomic_load_n(&sl->s.millideg, __ATOMIC_RELAXED);
+        tmp.temp         = __atomic_load_n(&sl->s.temp, __ATOMIC_RELAXED);
+        tmp.count_remain = __atomic_load_n(&sl->s.count_remain, __ATOMIC_RELAXED);
+        tmp.count_per_c  = __atomic_load_n(&sl->s.count_per_c, __ATOMIC_RELAXED);
+        tmp.status       = __atomic_load_n(&sl->s.status, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != s1)
+            continue;
+        if (tmp.num != num)
+            return -1;
+        *out = tmp;
+        return 0;
+    }
+    return -1;
+}
+
+/* Newest reading.  Returns 0, or -1 if the ring is still empty. */
+static inline int ds1821_shm_latest(const struct ds1821_shm *shm,
+                                    struct ds1821_shm_sample *out)
+{
+    uint64_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    if (head == 0)
+        return -1;
+    return ds1821_shm_read(shm, head - 1, out);
+}
+
+/*
+ * Copy up to max readings, newest first.  Returns the number copied,
+ * which stops early at the oldest slot that hasn't been overwritten.
+ */
+static inline int ds1821_shm_history(const struct ds1821_shm *shm,
+                                     struct ds1821_shm_sample *out, int max)
+{
+    uint64_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    while (n < max && (uint64_t)n < head && n < DS1821_SHM_SLOTS) {
+        if (ds1821_shm_read(shm, head - 1 - n, &out[n]) < 0)
+            break;
+        n++;
+    }
+    return n;
+}
+
+/* ── Writer (used by the daemon) ─────────────────────────────────── */
+
+/*
+ * Create or reopen a ring read-write.  An existing ring with a matching
+ * layout is kept, so history survives a daemon restart.  A slot left odd
+ * by a writer that died inside it is dropped from the history and made
+ * even again, so its parity stays right for the next write.
+ */
+static inline struct ds1821_shm *ds1821_shm_create(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    int fresh = fstat(fd, &st) < 0 || st.st_size != (off_t)sizeof(struct ds1821_shm);
+    if (fresh && ftruncate(fd, sizeof(struct ds1821_shm)) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, sizeof(struct ds1821_shm), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    struct ds1821_shm *shm = p;
+    if (fresh || shm->magic != DS1821_SHM_MAGIC ||
+        shm->version != DS1821_SHM_VERSION || shm->nslots != DS1821_SHM_SLOTS ||
+        shm->slot_size != sizeof(struct ds1821_shm_slot)) {
+        memset(shm, 0, sizeof(*shm));
+        shm->version   = DS1821_SHM_VERSION;
+        shm->nslots    = DS1821_SHM_SLOTS;
+        shm->slot_size = sizeof(struct ds1821_shm_slot);
+        __atomic_store_n(&shm->magic, DS1821_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        for (int i = 0; i < DS1821_SHM_SLOTS; i++) {
+            struct ds1821_shm_slot *sl = &shm->slot[i];
+            if (sl->seq & 1) {
+                __atomic_store_n(&sl->s.num, UINT64_MAX, __ATOMIC_RELAXED);
+                __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+            }
+        }
+    }
+    return shm;
+}
+
+/* Append one reading.  Single writer only. */
+static inline void ds1821_shm_push(struct ds1821_shm *shm,
+                                   const struct ds1821_shm_sample *in)
+{
+    uint64_t num = shm->head;
+    struct ds1821_shm_slot *sl = &shm->slot[num % DS1821_SHM_SLOTS];
+    uint32_t seq = sl->seq;
+
+    __atomic_store_n(&sl->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&sl->s.num, num, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->s.time_ns, in->time_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->s.millideg, in->millideg, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->s.temp, in->temp, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->s.count_remain, in->count_remain, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->s.count_per_c, in->count_per_c, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->s.status, in->status, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->head, num + 1, __ATOMIC_RELEASE);
+}
+
+static inline void ds1821_shm_unmap(struct ds1821_shm *shm)
+{
+    if (shm)
+        munmap(shm, sizeof(struct ds1821_shm));
+}
+
+#endif /* DS1821_SHM_H */
@@ -14,6 +14,7 @@
 #   sudo ./test_hardware.sh              # run all tests
 #   sudo ./test_hardware.sh --skip-slow  # skip tests that take >5s
 #   sudo ./test_hardware.sh --power-gpio 4 --read-tout  # enable optional tests
+#   ./test_hardware.sh --sim --skip-slow  # no hardware: --engine sim, no root
 
 set -uo pipefail
 
@@ -25,6 +26,7 @@ GPIO_PIN=17
 POWER_PIN=""
 TOUT_TEST=0
 SKIP_SLOW=0
+SIM=0
 
 # Parse arguments
 while [[ $# -gt 0 ]]; do
@@ -33,13 +35,22 @@ while [[ $# -gt 0 ]]; do
         --read-tout)  TOUT_TEST=1;    shift ;;
         --gpio)       GPIO_PIN="$2";  shift 2 ;;
         --skip-slow)  SKIP_SLOW=1;    shift ;;
+        --sim)        SIM=1;          shift ;;
         --help|-h)
-            echo "Usage: sudo $0 [--power-gpio N] [--read-tout] [--gpio N] [--skip-slow]"
+            echo "Usage: sudo $0 [--power-gpio N] [--read-tout] [--gpio N] [--skip-slow] [--sim]"
             exit 0 ;;
         *) echo "Unknown option: $1"; exit 1 ;;
     esac
 done
 
+# The simulated bus keeps its EEPROM in a scratch file for the whole run
+if [[ $SIM -eq 1 ]]; then
+    SIM_DIR=$(mktemp -d /tmp/ds1821-sim.XXXXXX)
+    SIM_STATE="$SIM_DIR/eeprom"
+    trap 'rm -rf "$SIM_DIR"' EXIT
+    PROG="$PROG --engine sim --sim-state $SIM_STATE"
+fi
+
 # Pass --gpio to every ds1821-program invocation
 PROG_BIN="$PROG"
 PROG="$PROG --gpio $GPIO_PIN"
@@ -135,6 +146,7 @@ echo "  GPIO pin:    $GPIO_PIN"
 echo "  Power GPIO:  ${POWER_PIN:-not set (power-gpio tests skipped)}"
 echo "  Read TOUT:   $(if [[ $TOUT_TEST -eq 1 ]]; then echo yes; else echo 'no (use --read-tout to enable)'; fi)"
 echo "  Skip slow:   $SKIP_SLOW"
+echo "  Simulated:   $(if [[ $SIM -eq 1 ]]; then echo 'yes (--engine sim)'; else echo no; fi)"
 echo ""
 
 # ── Preconditions ──────────────────────────────────────────────────
@@ -143,7 +155,9 @@ printf "${BOLD}Preconditions${RESET}\n"
 echo "────────────────────────────────────────────────────────"
 
 # Root check
-if [[ $EUID -eq 0 ]]; then
+if [[ $SIM -eq 1 ]]; then
+    skip "Running as root (simulated bus)"
+elif [[ $EUID -eq 0 ]]; then
     pass "Running as root"
 else
     fail "Running as root" "must run with sudo"
@@ -152,7 +166,7 @@ else
 fi
 
 # Binary exists
-if [[ -x "$PROG_BIN" ]]; then
+if [[ -x "${PROG_BIN%% *}" ]]; then
     pass "ds1821-program binary exists"
 else
     fail "ds1821-program binary exists" "not found or not executable"
@@ -168,7 +182,9 @@ else
 fi
 
 # pigpiod not running (conflicts with direct pigpio use)
-if ! pgrep -x pigpiod >/dev/null 2>&1; then
+if [[ $SIM -eq 1 ]]; then
+    skip "pigpiod not running (simulated bus)"
+elif ! pgrep -x pigpiod >/dev/null 2>&1; then
     pass "pigpiod not running"
 else
     fail "pigpiod not running" "stop with: sudo systemctl stop pigpiod"
@@ -217,8 +233,20 @@ fi
 $PROG --bogus temp >/dev/null 2>&1
 assert_exit "Unknown option exits non-zero" 1 $?
 
+# Netlink engine can't read TOUT (DQ belongs to the kernel master)
+$PROG --engine netlink --read-tout probe >/dev/null 2>&1
+assert_exit "--engine netlink --read-tout rejected" 1 $?
+$PROG --engine netlink --watch-tout --config ./sensors.conf --once daemon >/dev/null 2>&1
+assert_exit "--engine netlink --watch-tout rejected" 1 $?
+
+# Sysfs engine needs a slave to talk to
+$PROG --engine sysfs probe >/dev/null 2>&1
+assert_exit "--engine sysfs without --w1-device fails" 1 $?
+
 # Non-root error
-if su -s /bin/bash nobody -c "$PROG_BIN temp" >/dev/null 2>&1; then
+if [[ $SIM -eq 1 ]]; then
+    skip "Non-root rejected (simulated bus needs no root)"
+elif su -s /bin/bash nobody -c "$PROG_BIN temp" >/dev/null 2>&1; then
     fail "Non-root rejected" "should require root"
 else
     pass "Non-root rejected"
@@ -295,6 +323,13 @@ else
     TEMP_VAL=$(echo "$TEMP_Q" | head -1)
     assert_range "temp -q in plausible range (-10..50)" -10 50 "$TEMP_VAL"
 
+    # Adaptive conversion wait
+    TEMP_P=$($PROG --poll-done temp 2>&1)
+    assert_exit "temp --poll-done exits 0" 0 $?
+    assert_match "temp --poll-done reports conversion time" "Conversion time: [0-9]+ ms" "$TEMP_P"
+    CONV_MS=$($PROG --poll-done status 2>&1 | grep -oP '^conv_ms=\K[0-9]+')
+    assert_range "status --poll-done conv_ms within window (0..1000)" 0 1000 "$CONV_MS"
+
     # Two consecutive reads should be close (within 2°C)
     TEMP_Q2=$($PROG -q temp 2>&1 | head -1)
     if [[ -n "$TEMP_Q2" && -n "$TEMP_VAL" ]]; then
@@ -414,6 +449,18 @@ else
     assert_eq "combined set-th readback" "28" "$GOT_TH"
     assert_eq "combined set-tl readback" "10" "$GOT_TL"
 
+    # provision from a config file, then again with nothing left to write
+    PROVCONF=$(mktemp)
+    echo "prov $GPIO_PIN th=27 tl=11" > "$PROVCONF"
+    $PROG_BIN -q --config "$PROVCONF" provision >/dev/null 2>&1
+    assert_exit "provision exits 0" 0 $?
+    CHECK_Q=$($PROG -q probe 2>&1)
+    assert_eq "provision TH readback" "27" "$(echo "$CHECK_Q" | grep -oP '^th=\K-?[0-9]+' | head -1)"
+    assert_eq "provision TL readback" "11" "$(echo "$CHECK_Q" | grep -oP '^tl=\K-?[0-9]+' | head -1)"
+    PROV_OUT=$($PROG_BIN --config "$PROVCONF" provision 2>&1)
+    assert_match "provision skips matching registers" "0 register\(s\) written" "$PROV_OUT"
+    rm -f "$PROVCONF"
+
     # Restore originals
     $PROG set-th "$ORIG_TH" set-tl "$ORIG_TL" >/dev/null 2>&1
     CHECK_Q=$($PROG -q probe 2>&1)
@@ -430,6 +477,16 @@ echo ""
 printf "${BOLD}6. Power GPIO (--power-gpio)${RESET}\n"
 echo "────────────────────────────────────────────────────────"
 
+# pinctrl only sees a real pin
+assert_power_high() {
+    if [[ $SIM -eq 1 ]]; then
+        skip "$1 (simulated bus)"
+        return
+    fi
+    PIN_STATE=$(pinctrl get "$POWER_PIN" 2>/dev/null | grep -oP 'hi|lo')
+    assert_eq "$1" "hi" "$PIN_STATE"
+}
+
 if [[ -z "$POWER_PIN" ]]; then
     skip "power-gpio not set (use --power-gpio N to enable)"
     skip "power pin persist"
@@ -442,8 +499,7 @@ else
     assert_match "probe with --power-gpio shows status" "Status register" "$PPROBE"
 
     # After gpioTerminate, power pin should stay HIGH
-    PIN_STATE=$(pinctrl get "$POWER_PIN" 2>/dev/null | grep -oP 'hi|lo')
-    assert_eq "power pin persisted HIGH" "hi" "$PIN_STATE"
+    assert_power_high "power pin persisted HIGH"
 
     if [[ $SKIP_SLOW -eq 1 ]]; then
         skip "temp with --power-gpio (slow)"
@@ -455,8 +511,7 @@ else
         assert_match "temp with --power-gpio is a number" '^-?[0-9]+\.[0-9]+$' "$PTEMP"
 
         # Pin should still be HIGH
-        PIN_STATE=$(pinctrl get "$POWER_PIN" 2>/dev/null | grep -oP 'hi|lo')
-        assert_eq "power pin still HIGH after temp" "hi" "$PIN_STATE"
+        assert_power_high "power pin still HIGH after temp"
     fi
 
     # Fix command (full cycle: set-oneshot + power-cycle + reload)
@@ -471,8 +526,24 @@ else
         assert_match "fix shows VDD ON" "VDD ON" "$FIX_OUT"
 
         # Pin should still be HIGH
-        PIN_STATE=$(pinctrl get "$POWER_PIN" 2>/dev/null | grep -oP 'hi|lo')
-        assert_eq "power pin HIGH after fix" "hi" "$PIN_STATE"
+        assert_power_high "power pin HIGH after fix"
+
+        # Short off time: the cycle should end well under the old 1 s
+        T0=$(date +%s%N)
+        FIX_OUT=$($PROG --power-gpio "$POWER_PIN" --off-ms 100 fix 2>&1)
+        FIX_RC=$?
+        FIX_MS=$(( ($(date +%s%N) - T0) / 1000000 ))
+        assert_exit "fix with --off-ms 100 exits 0" 0 "$FIX_RC"
+        assert_match "fix uses --off-ms" "waiting 100 ms" "$FIX_OUT"
+        assert_range "fix with --off-ms 100 time (ms)" 0 900 "$FIX_MS"
+
+        # The simulated part came back in 1-Wire mode; blank its EEPROM
+        # so the rest of the run talks to a thermostat again
+        if [[ $SIM -eq 1 ]]; then
+            SCAN_OUT=$($PROG --rescan --cache-dir "$SIM_DIR" scan 2>&1)
+            assert_match "fix leaves the part in 1-Wire mode" "family=0x22, CRC OK" "$SCAN_OUT"
+            : > "$SIM_STATE"
+        fi
     fi
 fi
 
@@ -495,7 +566,7 @@ else
 
     # Quiet probe should have tout=
     TOUT_Q=$($PROG -q --read-tout probe 2>&1)
-    assert_match "probe -q has tout=" "^tout=[01]" "$TOUT_Q"
+    assert_match "probe -q has tout=" $'(^|\n)tout=[01]' "$TOUT_Q"
 
     # Extract value
     TOUT_VAL=$(echo "$TOUT_Q" | grep -oP '^tout=\K[01]')
@@ -508,7 +579,7 @@ else
     # Status should also have tout=
     if [[ $SKIP_SLOW -eq 0 ]]; then
         TOUT_S=$($PROG --read-tout status 2>&1)
-        assert_match "status has tout=" "^tout=[01]" "$TOUT_S"
+        assert_match "status has tout=" $'(^|\n)tout=[01]' "$TOUT_S"
     else
         skip "status with --read-tout (slow)"
     fi
@@ -529,42 +600,199 @@ else
     TESTDIR="/run/ds1821/$TESTNAME"
     rm -rf "$TESTDIR" 2>/dev/null
 
-    # Run ds1821-update with a test name
-    # Use PROG env to point at our local binary
-    PROG="$PWD/ds1821-program" $UPDATE --name "$TESTNAME" --gpio "$GPIO_PIN" 2>&1
-    UPDATE_RC=$?
-
-    assert_exit "ds1821-update exits 0" 0 "$UPDATE_RC"
-    assert_file_exists "temperature file created" "$TESTDIR/temperature"
-    assert_file_exists "alarms file created" "$TESTDIR/alarms"
-    assert_file_exists "thresholds file created" "$TESTDIR/thresholds"
-
-    # Check temperature value
-    if [[ -f "$TESTDIR/temperature" ]]; then
-        MILLI=$(cat "$TESTDIR/temperature")
-        assert_match "temperature is integer millideg" '^-?[0-9]+$' "$MILLI"
-        assert_range "temperature millideg plausible (-10000..50000)" -10000 50000 "$MILLI"
+    # ds1821-update runs the binary itself, so it can't use the simulated bus
+    if [[ $SIM -eq 1 ]]; then
+        skip "ds1821-update (simulated bus)"
+    else
+        # Run ds1821-update with a test name
+        # Use PROG env to point at our local binary
+        PROG="$PWD/ds1821-program" $UPDATE --name "$TESTNAME" --gpio "$GPIO_PIN" 2>&1
+        UPDATE_RC=$?
+
+        assert_exit "ds1821-update exits 0" 0 "$UPDATE_RC"
+        assert_file_exists "temperature file created" "$TESTDIR/temperature"
+        assert_file_exists "alarms file created" "$TESTDIR/alarms"
+        assert_file_exists "thresholds file created" "$TESTDIR/thresholds"
+
+        # Check temperature value
+        if [[ -f "$TESTDIR/temperature" ]]; then
+            MILLI=$(cat "$TESTDIR/temperature")
+            assert_match "temperature is integer millideg" '^-?[0-9]+$' "$MILLI"
+            assert_range "temperature millideg plausible (-10000..50000)" -10000 50000 "$MILLI"
+        fi
+
+        # Check alarms format
+        if [[ -f "$TESTDIR/alarms" ]]; then
+            ALARMS=$(cat "$TESTDIR/alarms")
+            assert_match "alarms format" "^thf=[01] tlf=[01]$" "$ALARMS"
+        fi
+
+        # Check thresholds format
+        if [[ -f "$TESTDIR/thresholds" ]]; then
+            THRESHOLDS=$(cat "$TESTDIR/thresholds")
+            assert_match "thresholds format" "^th=-?[0-9]+ tl=-?[0-9]+$" "$THRESHOLDS"
+        fi
+
+        # Default name should be "0"
+        rm -rf /run/ds1821/0 2>/dev/null
+        PROG="$PWD/ds1821-program" $UPDATE --gpio "$GPIO_PIN" 2>&1
+        assert_file_exists "default name writes to /run/ds1821/0/" "/run/ds1821/0/temperature"
     fi
 
-    # Check alarms format
-    if [[ -f "$TESTDIR/alarms" ]]; then
-        ALARMS=$(cat "$TESTDIR/alarms")
-        assert_match "alarms format" "^thf=[01] tlf=[01]$" "$ALARMS"
+    # Config-file mode: one daemon --once cycle for every sensor
+    TESTCONF=$(mktemp)
+    echo "$TESTNAME $GPIO_PIN" > "$TESTCONF"
+    if [[ $SIM -eq 0 ]]; then
+        PROG="$PWD/ds1821-program" $UPDATE --config "$TESTCONF" 2>&1
+        assert_exit "ds1821-update --config exits 0" 0 $?
+        assert_file_exists "config mode writes temperature" "$TESTDIR/temperature"
     fi
 
-    # Check thresholds format
-    if [[ -f "$TESTDIR/thresholds" ]]; then
-        THRESHOLDS=$(cat "$TESTDIR/thresholds")
-        assert_match "thresholds format" "^th=-?[0-9]+ tl=-?[0-9]+$" "$THRESHOLDS"
+    # Daemon single cycle into a private run dir
+    DAEMON_DIR=$(mktemp -d)
+    $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" --once daemon 2>&1
+    assert_exit "daemon --once exits 0" 0 $?
+    assert_file_exists "daemon writes temperature" "$DAEMON_DIR/$TESTNAME/temperature"
+    assert_file_exists "daemon writes alarms" "$DAEMON_DIR/$TESTNAME/alarms"
+    assert_file_exists "daemon writes thresholds" "$DAEMON_DIR/$TESTNAME/thresholds"
+    assert_file_exists "daemon writes ring" "$DAEMON_DIR/$TESTNAME/ring"
+
+    # Uncached thresholds still published
+    rm -f "$DAEMON_DIR/$TESTNAME/thresholds"
+    $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" --cache-refresh 0 \
+        --once daemon 2>&1
+    assert_exit "daemon --cache-refresh 0 exits 0" 0 $?
+    assert_file_exists "daemon --cache-refresh 0 writes thresholds" \
+        "$DAEMON_DIR/$TESTNAME/thresholds"
+
+    # Prometheus textfile metrics
+    $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" \
+        --metrics "$DAEMON_DIR/ds1821.prom" --once daemon 2>&1
+    assert_exit "daemon --metrics exits 0" 0 $?
+    assert_match "metrics count one reading" \
+        "ds1821_readings_total\\{sensor=\"$TESTNAME\",gpio=\"$GPIO_PIN\"\\} 1" \
+        "$(cat "$DAEMON_DIR/ds1821.prom" 2>/dev/null)"
+    assert_match "metrics have a reset histogram" "ds1821_reset_seconds_count" \
+        "$(cat "$DAEMON_DIR/ds1821.prom" 2>/dev/null)"
+    if [[ -f "$DAEMON_DIR/$TESTNAME/temperature" ]]; then
+        assert_match "daemon temperature is integer millideg" '^-?[0-9]+$' \
+            "$(cat "$DAEMON_DIR/$TESTNAME/temperature")"
     fi
 
-    # Default name should be "0"
-    rm -rf /run/ds1821/0 2>/dev/null
-    PROG="$PWD/ds1821-program" $UPDATE --gpio "$GPIO_PIN" 2>&1
-    assert_file_exists "default name writes to /run/ds1821/0/" "/run/ds1821/0/temperature"
+    # History log: two cycles, then query it without root
+    $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" \
+        --history-dir "$DAEMON_DIR/hist" --once daemon 2>&1
+    $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" \
+        --history-dir "$DAEMON_DIR/hist" --once daemon 2>&1
+    assert_exit "daemon --history-dir exits 0" 0 $?
+    assert_file_exists "daemon writes history log" "$DAEMON_DIR/hist/$TESTNAME.hist"
+    HIST_OUT=$($PROG_BIN -q --history-dir "$DAEMON_DIR/hist" --from -1h history "$TESTNAME" 2>&1)
+    assert_exit "history exits 0" 0 $?
+    assert_match "history has both readings" '^2$' "$(echo "$HIST_OUT" | wc -l)"
+    assert_match "history line format" "^[0-9T:-]+Z $TESTNAME +-?[0-9]+ " "$HIST_OUT"
+    $PROG_BIN -q --history-dir "$DAEMON_DIR/hist" history nosuch >/dev/null 2>&1
+    assert_exit "history of an unknown sensor fails" 1 $?
+
+    # Publish policy: a huge delta leaves temperature alone after the first cycle
+    POLCONF=$(mktemp)
+    echo "$TESTNAME $GPIO_PIN delta=100000" > "$POLCONF"
+    timeout -s TERM 5 $PROG_BIN -q --config "$POLCONF" --run-dir "$DAEMON_DIR" \
+        --metrics "$DAEMON_DIR/pol.prom" --interval 1 daemon >/dev/null 2>&1
+    assert_match "delta= holds back unchanged readings" \
+        "ds1821_unchanged_total\\{sensor=\"$TESTNAME\",gpio=\"$GPIO_PIN\"\\} [1-9]" \
+        "$(cat "$DAEMON_DIR/pol.prom" 2>/dev/null)"
+    # Adaptive interval: a steady sensor's interval doubles from MIN
+    echo "$TESTNAME $GPIO_PIN interval=1:60" > "$POLCONF"
+    timeout -s TERM 5 $PROG_BIN -q --config "$POLCONF" --run-dir "$DAEMON_DIR" \
+        --metrics "$DAEMON_DIR/pol.prom" daemon >/dev/null 2>&1
+    ADAPT=$(grep "^ds1821_interval_seconds{sensor=\"$TESTNAME\"" "$DAEMON_DIR/pol.prom" \
+        2>/dev/null | awk '{print $2}')
+    assert_range "interval=1:60 grows on a steady sensor (s)" 2 60 "$ADAPT"
+    echo "$TESTNAME $GPIO_PIN interval=60:10" > "$POLCONF"
+    $PROG_BIN -q --config "$POLCONF" --run-dir "$DAEMON_DIR" --once daemon >/dev/null 2>&1
+    assert_exit "interval= with MAX below MIN is rejected" 1 $?
+    echo "$TESTNAME $GPIO_PIN delta=-1" > "$POLCONF"
+    $PROG_BIN -q --config "$POLCONF" --run-dir "$DAEMON_DIR" --once daemon >/dev/null 2>&1
+    assert_exit "negative delta= is rejected" 1 $?
+    rm -f "$POLCONF"
+
+    # --push: one UDP datagram per cycle with every sensor in it
+    $PROG_BIN -q --config "$TESTCONF" --push ftp://x --once daemon >/dev/null 2>&1
+    assert_exit "--push with an unknown scheme is rejected" 1 $?
+    if command -v python3 >/dev/null; then
+        python3 -c 'import socket; s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM); s.bind(("127.0.0.1", 18821)); s.settimeout(10); print(s.recv(65536).decode())' \
+            > "$DAEMON_DIR/push.out" 2>/dev/null &
+        PUSH_PID=$!
+        sleep 0.5
+        $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" \
+            --push udp://127.0.0.1:18821 --once daemon 2>&1
+        assert_exit "daemon --push exits 0" 0 $?
+        wait $PUSH_PID
+        assert_match "--push datagram has the reading" \
+            "\"sensor\":\"$TESTNAME\",\"gpio\":$GPIO_PIN,\"millideg\":-?[0-9]+" \
+            "$(cat "$DAEMON_DIR/push.out")"
+    else
+        skip "daemon --push (python3 not installed)"
+    fi
+
+    # Commands next to a running daemon go through its control socket
+    $PROG_BIN -q --config "$TESTCONF" --run-dir "$DAEMON_DIR" --interval 2 daemon \
+        >/dev/null 2>&1 &
+    CTL_PID=$!
+    sleep 2
+    if [[ -S "$DAEMON_DIR/ds1821d.sock" ]]; then
+        pass "daemon creates its control socket"
+    else
+        fail "daemon creates its control socket" "no socket at $DAEMON_DIR/ds1821d.sock"
+    fi
+    CTL_OUT=$($PROG_BIN --run-dir "$DAEMON_DIR" probe 2>&1)
+    assert_exit "probe via ds1821d exits 0" 0 $?
+    assert_match "probe goes via ds1821d" "via ds1821d" "$CTL_OUT"
+    CTL_OUT=$($PROG_BIN --run-dir "$DAEMON_DIR" -q status 2>&1)
+    assert_match "status via ds1821d has temperature" "temperature=-?[0-9]+" "$CTL_OUT"
+    # A bus option that matches none of the daemon's sensors runs locally
+    CTL_OUT=$($PROG_BIN --lock-wait 1 --run-dir "$DAEMON_DIR" --w1-master 7 probe 2>&1)
+    if [[ "$CTL_OUT" != *"via ds1821d"* ]]; then
+        pass "probe on another bus is not sent to ds1821d"
+    else
+        fail "probe on another bus is not sent to ds1821d" "got '$CTL_OUT'"
+    fi
+    # Thresholds from the socket are range-checked before any EEPROM write
+    if command -v python3 >/dev/null; then
+        CTL_OUT=$(python3 -c 'import socket, sys; s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); s.sendall(b"set gpio=" + sys.argv[2].encode() + b" quiet=1 verbose=0 tout=0 th=300\n"); print(s.makefile("rb").read().replace(b"\0", b" rc=").decode())' \
+            "$DAEMON_DIR/ds1821d.sock" "$GPIO_PIN" 2>&1)
+        assert_match "ds1821d rejects th=300 from the socket" "out of range.* rc=1" "$CTL_OUT"
+    else
+        skip "ds1821d threshold range check (python3 not installed)"
+    fi
+    # Without the socket, a second process waits for the bus, then gives up
+    if [[ $SIM -eq 1 ]]; then
+        skip "bus locks (each simulated bus is private)"
+    else
+        $PROG_BIN --lock-wait 1 --run-dir /tmp/ds1821-no-daemon probe >/dev/null 2>&1
+        assert_exit "probe without the socket waits, then fails on the lock" 1 $?
+    fi
+    kill -TERM $CTL_PID 2>/dev/null; wait $CTL_PID 2>/dev/null
+    # With the daemon gone, the same probe runs locally
+    $PROG_BIN --lock-wait 1 --run-dir "$DAEMON_DIR" -q probe >/dev/null 2>&1
+    assert_exit "probe runs locally once the daemon is gone" 0 $?
+
+    # Two sensors on one data pin without power pins can't be gated
+    GATECONF=$(mktemp)
+    printf 'a %s\nb %s\n' "$GPIO_PIN" "$GPIO_PIN" > "$GATECONF"
+    $PROG_BIN -q --config "$GATECONF" --run-dir "$DAEMON_DIR" --once daemon >/dev/null 2>&1
+    assert_exit "shared data pin without power pins is rejected" 1 $?
+    rm -f "$GATECONF"
+
+    # status --publish writes the same files directly, leaving no temp files
+    $PROG_BIN -q --run-dir "$DAEMON_DIR" --publish pub status >/dev/null 2>&1
+    assert_exit "status --publish exits 0" 0 $?
+    assert_file_exists "--publish writes temperature" "$DAEMON_DIR/pub/temperature"
+    assert_match "--publish leaves no temp files" '^0$' \
+        "$(find "$DAEMON_DIR/pub" -name '.*.tmp' | wc -l)"
 
     # Clean up
-    rm -rf "$TESTDIR" /run/ds1821/0 2>/dev/null
+    rm -rf "$TESTDIR" /run/ds1821/0 "$DAEMON_DIR" "$TESTCONF" 2>/dev/null
 fi
 
 echo ""
@@ -582,6 +810,123 @@ assert_exit "probe -v exits 0" 0 $?
 $PROG -v -q probe >/dev/null 2>&1
 assert_exit "probe -v -q exits 0" 0 $?
 
+# scan with a private ROM cache: full search, then cached verify path
+SCAN_CACHE=$(mktemp -d)
+$PROG --cache-dir "$SCAN_CACHE" --rescan scan >/dev/null 2>&1
+assert_exit "scan --rescan exits 0" 0 $?
+$PROG --cache-dir "$SCAN_CACHE" scan >/dev/null 2>&1
+assert_exit "scan (cached) exits 0" 0 $?
+rm -rf "$SCAN_CACHE"
+
+# Wave engine (no TX pin: writes DMA-timed, reads bit-banged)
+if [[ $SIM -eq 1 ]]; then
+    skip "probe --engine wave (simulated bus)"
+else
+    WAVE_Q=$($PROG --engine wave -q probe 2>&1)
+    assert_exit "probe --engine wave exits 0" 0 $?
+    assert_match "probe --engine wave has status=" "^status=0x[0-9A-Fa-f]" "$WAVE_Q"
+    if [[ -n "${ORIG_TH:-}" ]]; then
+        WAVE_TH=$(echo "$WAVE_Q" | grep -oP '^th=\K-?[0-9]+' | head -1)
+        BB_TH=$($PROG -q probe 2>&1 | grep -oP '^th=\K-?[0-9]+' | head -1)
+        assert_eq "wave and bitbang engines agree on TH" "$BB_TH" "$WAVE_TH"
+    fi
+fi
+
+$PROG --engine bogus probe >/dev/null 2>&1
+assert_exit "unknown --engine exits non-zero" 1 $?
+
+# Tight timing profile reads the same thresholds as standard
+TIGHT_Q=$($PROG --timing tight -q probe 2>&1)
+assert_exit "probe --timing tight exits 0" 0 $?
+if [[ -n "${ORIG_TH:-}" ]]; then
+    TIGHT_TH=$(echo "$TIGHT_Q" | grep -oP '^th=\K-?[0-9]+' | head -1)
+    BB_TH=$($PROG -q probe 2>&1 | grep -oP '^th=\K-?[0-9]+' | head -1)
+    assert_eq "tight and standard timing agree on TH" "$BB_TH" "$TIGHT_TH"
+fi
+
+# Single-shot reads (no verification) still work
+SINGLE_T=$($PROG --retries 0 -q temp 2>&1)
+assert_exit "temp --retries 0 exits 0" 0 $?
+assert_range "temp --retries 0 in range" -55 125 "$SINGLE_T"
+
+# Real-time bus thread
+RT_Q=$($PROG --rt-cpu 0 -q probe 2>&1)
+assert_exit "probe --rt-cpu 0 exits 0" 0 $?
+assert_match "probe --rt-cpu 0 has status=" "^status=0x[0-9A-Fa-f]" "$RT_Q"
+
+$PROG --timing bogus probe >/dev/null 2>&1
+assert_exit "unknown --timing exits non-zero" 1 $?
+
+# Slot timing profile (short run)
+if [[ $SIM -eq 1 ]]; then
+    $PROG profile --slots 128 >/dev/null 2>&1
+    assert_exit "profile rejected on the simulated bus" 1 $?
+else
+    PROFILE_OUT=$($PROG profile --slots 128 2>&1)
+    assert_exit "profile exits 0" 0 $?
+    assert_match "profile reports write1_low" "write1_low +128 " "$PROFILE_OUT"
+    assert_match "profile suggests timings" "Suggested timing" "$PROFILE_OUT"
+fi
+
+# Benchmark: JSON with every stage
+BENCH_DIR=$(mktemp -d)
+BENCH_OUT=$($PROG --run-dir "$BENCH_DIR" --poll-done --reads 3 bench 2>/dev/null)
+assert_exit "bench exits 0" 0 $?
+assert_match "bench reports all 3 reads ok" '"ok": 3,' "$BENCH_OUT"
+assert_match "bench times the conversion wait" '"convert": \{"n": 3' "$BENCH_OUT"
+if command -v python3 >/dev/null; then
+    echo "$BENCH_OUT" | python3 -m json.tool >/dev/null 2>&1
+    assert_exit "bench output is valid JSON" 0 $?
+fi
+if [[ $SIM -eq 1 ]]; then
+    # Virtual time: a full reading costs microseconds of CPU
+    BENCH_OUT=$($PROG --run-dir "$BENCH_DIR" --reads 2000 bench 2>/dev/null)
+    assert_match "sim bench reports all 2000 reads ok" '"ok": 2000,' "$BENCH_OUT"
+    WALL_RATE=$(echo "$BENCH_OUT" | grep -oP '"wall_reads_per_s": \K[0-9]+')
+    assert_range "sim bench wall-clock reads/s" 200 10000000 "$WALL_RATE"
+    BENCH_OUT=$($PROG --run-dir "$BENCH_DIR" --sim-flip 2000 --reads 200 bench 2>/dev/null)
+    assert_match "sim bench with flipped slots retries" '"retries": [1-9]' "$BENCH_OUT"
+fi
+rm -rf "$BENCH_DIR"
+
+# libds1821: async start/poll/fetch from a small C client
+if [[ -f ./libds1821.so ]]; then
+    LIBTEST=$(mktemp -d)
+    LIB_ENGINE=NULL
+    [[ $SIM -eq 1 ]] && LIB_ENGINE='"sim"'    # no pigpio, root or bus lock
+    cat > "$LIBTEST/t.c" <<EOF
+#include <stdio.h>
+#include "ds1821.h"
+int main(void)
+{
+    struct ds1821_config cfg = DS1821_CONFIG_INIT($GPIO_PIN);
+    struct ds1821_reading r;
+    if (ds1821_init($LIB_ENGINE, 0) < 0)
+        return 1;
+    struct ds1821 *d = ds1821_open(&cfg);
+    if (!d || ds1821_start_conversion(d) < 0)
+        return 1;
+    while (ds1821_poll(d) == 0)
+        ;
+    int ret = ds1821_fetch(d, &r);
+    printf("%d\\n", r.temp);
+    ds1821_close(d);
+    ds1821_exit();
+    return ret < 0;
+}
+EOF
+    if gcc -I. -o "$LIBTEST/t" "$LIBTEST/t.c" -L. -lds1821 -lpigpio 2>/dev/null; then
+        LIB_T=$(LD_LIBRARY_PATH=.${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH} "$LIBTEST/t" 2>/dev/null)
+        assert_exit "libds1821 client exits 0" 0 $?
+        assert_range "libds1821 temperature in range" -55 125 "$LIB_T"
+    else
+        skip "libds1821 client (cannot compile)"
+    fi
+    rm -rf "$LIBTEST"
+else
+    skip "libds1821 (not built)"
+fi
+
 # set-th without value (should fail or show usage)
 $PROG set-th 2>/dev/null
 SET_NO_VAL_RC=$?